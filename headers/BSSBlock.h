@@ -6,7 +6,12 @@
 #include <fstream>
 #include <cstring>
 #include <cstdint>
+#include <iterator>
 #include "ZipCodeRecordBuffer.h"
+#include "RecordView.h"
+#include "FieldDictionary.h"
+#include "BSSFileHeader.h"
+#include "ZipKey.h"
 
 /**
  * @brief Represents a single block in the file.
@@ -14,6 +19,27 @@
  *
  * It manages a raw byte buffer and provides methods to pack records
  * into it and unpack them. It contains its own block-level header.
+ *
+ * Two on-disk layouts are supported, selected by the file's format version:
+ *  - Version 1 (length-prefixed): [header][len][record][len][record]...
+ *    Records are in insertion order and the highest key has to be
+ *    recomputed by parsing every record.
+ *  - Version 2 (slotted): [header][slot 0][slot 1]...  free  ...[records]
+ *    Slots (offset, length, key) grow from the front and are kept sorted
+ *    by key; record data grows from the back. The highest key lives in
+ *    the block header, so loading a block is O(1) and an in-block lookup
+ *    is a binary search over the slots.
+ *  - Version 3 (front-coded): [header][entry][entry]... free ...[restarts]
+ *    Records are stored in key order, each split into its key part (the
+ *    zip) and the rest, and each part is front-coded against the previous
+ *    record: [keyShared][keyLen][restShared][restLen][key bytes][rest bytes].
+ *    Neighbouring zips share their leading digits and neighbouring records
+ *    often share place, state and county, so entries are much shorter
+ *    than the records. Every RESTART_INTERVAL-th entry is stored in full
+ *    and its offset is kept in a uint16 array at the end of the block; a
+ *    lookup binary-searches those restart points and decodes at most one
+ *    group. dataStart holds the end of the entries. Deleting a record
+ *    keeps the other restart points, which guarantees the block shrinks.
  */
 class BSSBlock {
 public:
@@ -23,9 +49,63 @@ public:
         int successorRBN;
         int predecessorRBN;
         char blockType; // 'A' = Active, 'V' = Avail, 'H' = Header (for RBN 0)
+
+        // Version 2 and 3 blocks only; overlaps record data in version 1
+        char highestKey[ZIP_CODE_LENGTH + 1]; // NUL-terminated
+        uint16_t dataStart;                   // Offset of the lowest record byte (v3: end of the entries)
+        uint16_t restartCount;                // Version 3 only: restart points at the end of the block
+    };
+
+    // Version 1 records start right after the original 16-byte header
+    static const uint32_t LENGTH_PREFIXED_HEADER_SIZE = 16;
+
+    // Slot directory entry: [offset:uint16][length:uint16][key:ZIP_CODE_LENGTH]
+    static const uint32_t SLOT_SIZE = 2 * sizeof(uint16_t) + ZIP_CODE_LENGTH;
+
+    // Front-coded entry header: [keyShared][keyLen][restShared][restLen], one byte each
+    static const uint32_t ENTRY_HEADER_SIZE = 4;
+
+    // Every this many front-coded entries one is stored in full (a restart point)
+    static const uint32_t RESTART_INTERVAL = 8;
+
+    // Supported block sizes; offsets inside a block (dataStart, slots) are uint16
+    static const uint32_t MIN_BLOCK_SIZE = 128;
+    static const uint32_t MAX_BLOCK_SIZE = 32768;
+
+    /**
+     * @brief Forward iterator yielding a RecordView for each record in the block.
+     * @note Views point into the block buffer (for front-coded blocks, into
+     *       the block's decoded copy of its records); they are invalidated
+     *       by any change to the block (addRecord, clear, read, load).
+     */
+    class RecordIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = RecordView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const RecordView*;
+        using reference = const RecordView&;
+
+        RecordIterator(const BSSBlock* block, uint32_t index);
+
+        reference operator*() const { return current; }
+        pointer operator->() const { return &current; }
+        RecordIterator& operator++();
+        bool operator==(const RecordIterator& other) const { return index == other.index; }
+        bool operator!=(const RecordIterator& other) const { return index != other.index; }
+
+    private:
+        void locate();
+
+        const BSSBlock* block;
+        uint32_t index;     // Record number, == count at the end
+        uint32_t count;
+        uint32_t position;  // Byte offset of the next length prefix (version 1)
+        RecordView current;
     };
 
-    BSSBlock(uint32_t bSize = 512);
+    BSSBlock(uint32_t bSize = 512, uint32_t formatVersion = BSS_VERSION_CURRENT,
+             RecordEncoding encoding = RecordEncoding::Text, FieldDictionary* dictionary = nullptr);
     ~BSSBlock();
 
     // Initializes block to an empty, active state
@@ -42,9 +122,54 @@ public:
      * @brief Tries to add a record to this block.
      * @param record The record object to pack.
      * @return True if the record fit, false otherwise.
+     * @note Slotted and front-coded blocks keep their records in key order.
+     *       A front-coded block appends a record with the highest key in
+     *       place and re-encodes itself for any other insert.
      */
     bool addRecord(const ZipCodeRecordBuffer& record);
 
+    /**
+     * @brief Adds a record only while the block stays within a fill limit.
+     * @param record The record object to pack.
+     * @param usedBytesLimit Maximum getUsedBytes() after the add; ignored
+     *                       for the first record of an empty block.
+     * @return True if the record was added.
+     * @note Used at creation time to leave headroom for later inserts.
+     */
+    bool addRecord(const ZipCodeRecordBuffer& record, uint32_t usedBytesLimit);
+
+    /**
+     * @brief Removes the first record with a zip code, keeping the block links.
+     * @param zipCode The key to remove.
+     * @return False if the block holds no such record.
+     * @note Never fails for lack of space: the block only shrinks.
+     */
+    bool removeRecord(std::string_view zipCode);
+
+    /**
+     * @brief Looks up a record by zip code within this block.
+     * @param zipCode The key to find.
+     * @param out Receives the unpacked record when found.
+     * @return True if the block holds a record with that key.
+     * @note Binary search over the slots for version 2 and over the restart
+     *       points for version 3, linear scan for version 1.
+     */
+    bool findRecord(const std::string& zipCode, ZipCodeRecordBuffer& out) const;
+
+    /**
+     * @brief Zero-copy variant of findRecord.
+     * @param zipCode The key to find.
+     * @param out Receives a view into this block's buffer when found.
+     * @return True if the block holds a record with that key.
+     * @note In a front-coded block the view points at a decoded copy that
+     *       the next findRecord call on this block overwrites.
+     */
+    bool findRecord(std::string_view zipCode, RecordView& out) const;
+
+    // Iteration over the records as views (in key order for version 2 and 3 blocks)
+    RecordIterator begin() const { return RecordIterator(this, 0); }
+    RecordIterator end() const { return RecordIterator(this, recordLimit()); }
+
     /**
      * @brief Reads a block from the file at a specific RBN.
      * @param file The file stream.
@@ -54,23 +179,132 @@ public:
      */
     bool read(std::fstream& file, int rbn, uint32_t bSize);
 
+    /**
+     * @brief Loads a block image that is already in memory (e.g. a cache frame).
+     * @param src Pointer to bSize bytes holding the raw block.
+     * @param bSize The block size (from file header).
+     * @param formatVersion The file's block format version.
+     * @param encoding The file's record encoding.
+     * @param dictionary The file's dictionary (BinaryDictionary files only).
+     * @return True on success.
+     */
+    bool load(const char* src, uint32_t bSize, uint32_t formatVersion,
+              RecordEncoding encoding = RecordEncoding::Text, FieldDictionary* dictionary = nullptr);
+
+    /**
+     * @brief Points the block at an existing block image without copying it.
+     * @param src Pointer to bSize bytes (e.g. inside a read-only file mapping).
+     * @param bSize The block size (from file header).
+     * @param formatVersion The file's block format version.
+     * @param encoding The file's record encoding.
+     * @param dictionary The file's dictionary (BinaryDictionary files only).
+     * @return True on success.
+     * @note The block does not own src, which must outlive it. The first
+     *       mutating call (clear, addRecord, ...) copies the image into a
+     *       private buffer; writing through getHeader() before that is
+     *       not allowed.
+     */
+    bool attach(const char* src, uint32_t bSize, uint32_t formatVersion,
+                RecordEncoding encoding = RecordEncoding::Text, FieldDictionary* dictionary = nullptr);
+
+    /**
+     * @brief Turns this block into one link of a file's dictionary chain.
+     * @param nextRBN The next block of the chain (-1 if this is the last).
+     * @param data Up to getDictionaryCapacity() bytes of the dictionary image.
+     * @note Dictionary blocks have type 'D' and no records; the image bytes
+     *       follow the header fields every block format shares.
+     */
+    void makeDictionaryBlock(int nextRBN, const char* data, uint32_t length);
+
+    uint32_t getDictionaryCapacity() const { return blockSize - LENGTH_PREFIXED_HEADER_SIZE; }
+    const char* getDictionaryData() const { return buffer + LENGTH_PREFIXED_HEADER_SIZE; }
+
     // Writes the block's buffer to the file at a specific RBN
     bool write(std::fstream& file, int rbn) const;
 
-    // Gets all records from this block, unpacked.
+    // Gets all records from this block, unpacked (in key order for version 2 and 3 blocks).
     std::vector<ZipCodeRecordBuffer> unpackAllRecords() const;
 
     // --- Accessors ---
-    std::string getHighestKey() const { return highestKey; }
+    std::string getHighestKey() const { return highestKey.toString(); }
+    ZipKey getHighestZipKey() const { return highestKey; }
+    uint32_t getBlockSize() const { return blockSize; }
+    uint32_t getFormatVersion() const { return formatVersion; }
+    RecordEncoding getRecordEncoding() const { return recordEncoding; }
+    const char* getBuffer() const { return buffer; }
+
+    // Bytes taken by records and their per-record overhead (length prefix, slot, or
+    // front-coded entries and restart points)
+    uint32_t getUsedBytes() const;
+
+    // Bytes available for records and their overhead in an empty block
+    uint32_t getCapacityBytes() const { return blockSize - headerSize(); }
 
     // (Inlined for performance, as it's a simple cast)
     BlockHeader* getHeader() const { return reinterpret_cast<BlockHeader*>(buffer); }
 
 private:
+    // Rebuilds currentSize and highestKey from the raw buffer
+    void parse();
+
+    // Gives the block a private buffer of blockSize bytes, keeping its contents
+    void ensureOwned();
+
+    bool isSlotted() const { return formatVersion == BSS_VERSION_SLOTTED; }
+    bool isFrontCoded() const { return formatVersion == BSS_VERSION_FRONT_CODED; }
+    bool hasKeyedHeader() const { return formatVersion >= BSS_VERSION_SLOTTED; }
+    uint32_t headerSize() const {
+        return hasKeyedHeader() ? sizeof(BlockHeader) : LENGTH_PREFIXED_HEADER_SIZE;
+    }
+
+    // Slot directory access (version 2)
+    char* slotAt(uint32_t i) const { return buffer + sizeof(BlockHeader) + i * SLOT_SIZE; }
+    void readSlot(uint32_t i, uint16_t& offset, uint16_t& length) const;
+    ZipKey slotKey(uint32_t i) const {
+        return ZipKey::fromField(slotAt(i) + 2 * sizeof(uint16_t), ZIP_CODE_LENGTH);
+    }
+
+    // Number of records the iterator visits (0 for non-active blocks)
+    uint32_t recordLimit() const {
+        return getHeader()->blockType == 'A' ? getHeader()->recordCount : 0;
+    }
+
+    bool addRecordLengthPrefixed(const std::string& packedRecord);
+    bool addRecordSlotted(const std::string& packedRecord, const std::string& zip, ZipKey key);
+
+    // Front-coded layout (version 3)
+    struct DecodedRecord {
+        uint32_t offset;  // Into 'expanded'
+        uint32_t length;
+        bool restart;     // Stored in full, listed in the restart array
+    };
+
+    // Writes the entries and restart points; the caller updates recordCount
+    bool addRecordFrontCoded(const std::string& packedRecord, ZipKey key, uint32_t usedBytesLimit);
+    bool rewriteFrontCoded(const std::vector<std::string>& records, const std::vector<bool>& restarts,
+                           uint32_t usedBytesLimit);
+    bool removeRecordFrontCoded(ZipKey key);
+    uint16_t restartOffset(uint32_t i) const;
+    size_t keyPartLength(std::string_view packedRecord) const;
+    ZipKey keyPartKey(std::string_view keyPart) const;
+    uint32_t encodeEntry(char* out, std::string_view previous, std::string_view record) const;
+    bool decodeEntry(uint32_t& pos, uint32_t end, std::string& key, std::string& rest) const;
+    void expand() const;
+
     uint32_t blockSize;
-    uint32_t currentSize; // Current write position in buffer
+    uint32_t formatVersion; // BSS_VERSION_* of the file this block belongs to
+    RecordEncoding recordEncoding; // How records are packed (from the file's header schema)
+    FieldDictionary* dictionary;   // Codes for State/County in BinaryDictionary files
+    uint32_t currentSize; // Current write position in buffer (version 1)
     char* buffer;         // The raw byte buffer
-    std::string highestKey; // Highest key in this block
+    bool ownsBuffer;      // False while attached to memory owned by someone else
+    ZipKey highestKey;    // Highest key in this block
+
+    // Decoded records of a front-coded block, built on first iteration
+    mutable std::string expanded;
+    mutable std::vector<DecodedRecord> expandedRecords;
+    mutable bool expandedValid;
+    mutable std::string lookupRecord;  // The record the last findRecord decoded
 };
 
-#endif // BSSBLOCK_H
\ No newline at end of file
+#endif // BSSBLOCK_H
@@ -4,14 +4,58 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
 #include "BSSFileHeader.h"
 #include "BSSBlock.h"
 #include "ZipCodeRecordBuffer.h"
 #include "BSSIndex.h"
+#include "BlockCache.h"
+#include "WriteAheadLog.h"
+#include "FieldDictionary.h"
 #include "HeaderBuffer.h" // <-- Added Project 2.0 header
 
+/**
+ * @brief Knobs for BSSFile::create.
+ */
+struct BSSCreateOptions {
+    // Worker threads for parsing and sorting (0 = one per hardware thread).
+    // The file produced is byte-identical for every thread count.
+    unsigned threads = 1;
+
+    // Memory budget in bytes for sorting (0 = sort everything in memory).
+    // When set, the .dat file is streamed, sorted runs are spilled to temporary
+    // files next to the .bss file and k-way merged straight into block packing,
+    // so memory use stays near the budget whatever the input size. The output
+    // matches the in-memory path byte for byte; threads is not used.
+    size_t memoryBudget = 0;
+
+    // Block size in bytes, BSSBlock::MIN_BLOCK_SIZE .. MAX_BLOCK_SIZE (e.g. 4096 to match the page size)
+    uint32_t blockSize = 512;
+
+    // Fraction of each block's record space filled at creation, (0, 1].
+    // Below 1 every block keeps headroom so early inserts do not split at once.
+    double fillFactor = 1.0;
+
+    // How records are stored in the blocks. The binary encodings fit more
+    // records per block and need no number parsing on reads; BinaryFixed
+    // keeps coordinates to a millionth of a degree, BinaryDouble exactly.
+    // BinaryDictionary is BinaryFixed with State/County stored as codes
+    // into a per-file dictionary.
+    RecordEncoding recordEncoding = RecordEncoding::Text;
+
+    // Block format (BSS_VERSION_*). BSS_VERSION_FRONT_CODED front-codes
+    // each block's records against their predecessors: more records per
+    // block, so fewer blocks and index entries, for a little decoding work
+    // on every read. BSS_VERSION_LENGTH_PREFIXED keeps only one header
+    // block, so it takes text records and blocks that hold the whole header.
+    uint32_t formatVersion = BSS_VERSION_CURRENT;
+};
+
 /**
  * @brief Main class for managing a Blocked Sequence Set file.
  *
@@ -20,25 +64,168 @@
  */
 class BSSFile {
 public:
+    // How open() gives access to the blocks
+    enum class OpenMode {
+        ReadWrite,       // fstream + block cache; all operations allowed
+        MappedReadOnly   // Whole file memory-mapped; readBlock attaches to the mapping
+    };
+
+    // Access pattern hint for the mapped pages (no effect in ReadWrite mode)
+    enum class AccessPattern {
+        Random,          // Point lookups: no readahead
+        Sequential       // Chain walks and dumps: aggressive readahead
+    };
+
+    // Outcome of one key in a lookupBatch call
+    struct LookupResult {
+        std::string zipCode;
+        bool found = false;
+        int rbn = -1;                  // Block the index pointed to (-1 if none)
+        ZipCodeRecordBuffer record;    // Valid only when found
+    };
+
+    // One entry of a change set for applyChanges
+    struct Change {
+        enum class Kind { Upsert, Delete };
+        Kind kind = Kind::Upsert;
+        ZipCodeRecordBuffer record;    // Upsert: the record to insert or replace
+        std::string zipCode;           // Delete: the key to remove
+
+        static Change upsert(const ZipCodeRecordBuffer& rec) { return {Kind::Upsert, rec, std::string()}; }
+        static Change erase(const std::string& zip) { return {Kind::Delete, ZipCodeRecordBuffer(), zip}; }
+        ZipKey key() const { return kind == Kind::Upsert ? record.getZipKey() : ZipKey(zipCode); }
+    };
+
+    // What one applyChanges call did
+    struct ApplyStats {
+        uint32_t inserted = 0;
+        uint32_t updated = 0;          // Upserts that replaced an existing record
+        uint32_t deleted = 0;
+        uint32_t notFound = 0;         // Deletes of keys that were not in the file
+        uint32_t blocksRewritten = 0;  // Blocks repacked, including new ones from splits
+    };
+
     BSSFile();
+    ~BSSFile();
 
     /**
      * @brief Creates a new .bss file from a Project 2.0 .dat file.
      * @note Implements Task 3. Reads from the length-indicated file.
+     *       With more than one thread, chunks of the file are parsed and
+     *       sorted in parallel, the sorted runs are merged pairwise, and
+     *       blocks are written on a background thread while packing continues.
+     * @note The BSSIndex is filled in as blocks are written and saved as
+     *       <bssFilename>.idx, so the new file is never rescanned to index it.
+     */
+    bool create(const std::string& bssFilename, const std::string& proj2DatFile,
+                const BSSCreateOptions& options = BSSCreateOptions());
+
+    /**
+     * @brief Creates a new .bss file straight from the CSV source, without a .dat file.
+     * @param bssFilename The file to create (truncated if it exists).
+     * @param csvFile CSV with a header row; every non-empty line after it is a record.
+     * @param options As for create(); a memory budget streams the CSV through the external sort.
+     * @return True on success. The file is closed afterwards.
+     * @note The CSV is read once; the index is saved as create() does. The
+     *       blocks match what create() makes from the .dat file processFile
+     *       writes for the same CSV.
+     */
+    bool createFromCsv(const std::string& bssFilename, const std::string& csvFile,
+                       const BSSCreateOptions& options = BSSCreateOptions());
+
+    /**
+     * @brief Opens an existing .bss file.
+     * @param bssFilename The file to open.
+     * @param mode ReadWrite, or MappedReadOnly for read-mostly lookups.
+     * @return True on success.
+     * @note Operations logged in <bssFilename>.wal by a session that did not
+     *       close the file are replayed first, in either mode. In ReadWrite
+     *       mode every insert and delete is logged there before any of its
+     *       blocks reach the file (see setGroupCommit).
+     * @note In MappedReadOnly mode blocks returned by readBlock point straight
+     *       into the mapping (no copy, no block cache) and stay valid until
+     *       close(). addRecord/deleteRecord/writeBlock fail. Where mmap is not
+     *       available (Windows) the file is opened read-only through fstream.
      */
-    bool create(const std::string& bssFilename, const std::string& proj2DatFile);
+    bool open(const std::string& bssFilename, OpenMode mode = OpenMode::ReadWrite);
 
-    // Opens an existing .bss file
-    bool open(const std::string& bssFilename);
+    /**
+     * @brief Rewrites a .bss file in the current block format version.
+     * @param oldFilename The file to upgrade (any supported version).
+     * @param newFilename Where to write the result; may equal oldFilename.
+     * @return True on success.
+     * @note RBNs change, so the index is rewritten as <newFilename>.idx
+     *       while the blocks are packed.
+     */
+    static bool upgrade(const std::string& oldFilename, const std::string& newFilename);
 
     void close();
 
-    // Reads a block into the provided block object
+    // Reads a block into the provided block object (through the block cache)
     bool readBlock(int rbn, BSSBlock& block);
     
-    // Writes a block from the provided block object
+    // Writes a block from the provided block object (buffered until flush/close)
     bool writeBlock(int rbn, const BSSBlock& block);
 
+    /**
+     * @brief Writes all dirty cached blocks, and the header if it changed, back to the file.
+     * @note The header is kept in memory between flushes, so a split or
+     *       merge no longer rewrites it once per block it touches.
+     */
+    bool flush();
+
+    /**
+     * @brief Makes every change durable in the file itself (a checkpoint).
+     * @note Syncs the log, flush()es, fsyncs the file and empties the log.
+     *       close() ends with the same, and then marks the file clean.
+     */
+    bool sync();
+
+    // False if the last session that opened the file for writing never closed it
+    bool wasClosedCleanly() const { return lastCloseClean; }
+
+    /**
+     * @brief Sets how many operations share one fsync of the log (group commit).
+     * @param operations 1 syncs every insert/delete before it returns.
+     * @note A crash loses at most the operations of the unsynced group; each
+     *       one is either replayed whole or not at all. sync() and close()
+     *       always sync.
+     */
+    void setGroupCommit(size_t operations);
+
+    // Tells the OS how the mapped blocks are about to be read (madvise)
+    void adviseAccess(AccessPattern pattern);
+
+    // True if blocks are served from a memory mapping
+    bool isMapped() const { return mapping != nullptr; }
+
+    /**
+     * @brief Resizes the block cache and selects its eviction policy.
+     * @param capacity Number of block frames to keep in memory.
+     * @param policy LRU or CLOCK replacement.
+     */
+    void setCacheOptions(size_t capacity, BlockCache::Policy policy);
+
+    // Hit/miss/eviction counters of the block cache
+    const CacheStats& getCacheStats() const;
+
+    // Zeroes the block cache counters (e.g. after warming up)
+    void resetCacheStats();
+
+    /**
+     * @brief Looks up many zip codes, reading each block they touch only once.
+     * @param zipCodes The keys to look up (duplicates allowed).
+     * @param index The highest-key index for this file.
+     * @return One result per key, in the order of zipCodes.
+     * @note Keys are resolved to RBNs first, then the distinct blocks are
+     *       read in ascending RBN order and every key for a block is
+     *       answered from that single read.
+     */
+    std::vector<LookupResult> lookupBatch(const std::vector<std::string>& zipCodes, const BSSIndex& index);
+
+    // Same, using the file's live index
+    std::vector<LookupResult> lookupBatch(const std::vector<std::string>& zipCodes);
+
     /**
      * @brief Dumps blocks in their physical RBN order (Task 8).
      */
@@ -63,6 +250,22 @@ public:
      */
     bool deleteRecord(const std::string& zipCode);
 
+    /**
+     * @brief Applies a change set in one forward sweep over the sequence set.
+     * @param sortedChanges Upserts and deletes in key order; if they are not,
+     *                      a sorted copy is used. Of several changes to one
+     *                      key only the last counts.
+     * @param stats Optional; receives what was done.
+     * @return True if every change was applied.
+     * @note Each affected block is read, merged with all of its changes and
+     *       rewritten once, split into as many evenly filled blocks as it
+     *       needs, unlinked when it empties, or merged/redistributed with a
+     *       neighbour when it falls below minimum capacity. Every block's
+     *       changes form one logged operation, so on failure the blocks
+     *       already done stay applied and the rest of the set does not.
+     */
+    bool applyChanges(const std::vector<Change>& sortedChanges, ApplyStats* stats = nullptr);
+
     /**
      * @brief Gets an available block from the avail list, or creates a new one.
      * @return RBN of available block, or -1 if error
@@ -78,7 +281,127 @@ public:
     // --- Accessors ---
     const BSSFileHeader& getHeader() const;
 
+    /**
+     * @brief State/County codes of a BinaryDictionary file (empty otherwise).
+     * @note A state-filtered scan can look its state up once with find()
+     *       and compare RecordView::getStateCode() per record.
+     */
+    const FieldDictionary& getDictionary() const { return dictionary; }
+
+    /**
+     * @brief The live block index used by addRecord/deleteRecord.
+     * @note Built from the sequence set on first use, then kept in sync
+     *       incrementally by splits, merges and redistributions.
+     */
+    const BSSIndex& getIndex();
+
+    /**
+     * @brief Loads an index file as the live index, rebuilding it if it is stale.
+     * @param indexFilename The .idx file belonging to this sequence set.
+     * @return True if the index was loaded, or rebuilt and written back.
+     * @note The index is stale when it was written for another generation
+     *       of this file (see BSSFileHeader::getGeneration), or is missing or
+     *       damaged. Inserts and deletes keep the live index in sync, and
+     *       close() writes it back under the new generation, so the next
+     *       open finds it current instead of rebuilding it.
+     */
+    bool loadIndex(const std::string& indexFilename);
+
+    // Writes the live index to the file given to loadIndex, tagged with the current generation
+    bool saveIndex();
+
 private:
+    /**
+     * @brief Sorts records and packs them into a fresh sequence set file and its index.
+     * @param bssFilename The file to create (truncated if it exists).
+     * @param records The records to store; stable-sorted unless already in order, then moved from.
+     * @param backgroundWrites Write finished blocks on a separate thread.
+     * @param fillFactor Fraction of each block's record space to fill.
+     * @param encoding How records are stored in the blocks.
+     * @param formatVersion The block format to write.
+     * @return True on success. The file is closed afterwards.
+     */
+    bool writeSequenceSet(const std::string& bssFilename, std::vector<ZipCodeRecordBuffer>& records,
+                          bool backgroundWrites = false, double fillFactor = 1.0,
+                          RecordEncoding encoding = RecordEncoding::Text,
+                          uint32_t formatVersion = BSS_VERSION_CURRENT);
+
+    /**
+     * @brief Packs records, supplied in key order, into a fresh sequence set file.
+     *
+     * The index is built from the blocks as they are written and saved as <bssFilename>.idx.
+     * @param bssFilename The file to create (truncated if it exists).
+     * @param nextRecord Fills in the next record; returns false at the end.
+     * @param backgroundWrites Write finished blocks on a separate thread.
+     * @param fillFactor Fraction of each block's record space to fill.
+     * @param encoding How records are stored in the blocks.
+     * @param formatVersion The block format to write.
+     * @return True on success. The file is closed afterwards.
+     */
+    bool packSequenceSet(const std::string& bssFilename,
+                         const std::function<bool(ZipCodeRecordBuffer&)>& nextRecord,
+                         bool backgroundWrites, double fillFactor = 1.0,
+                         RecordEncoding encoding = RecordEncoding::Text,
+                         uint32_t formatVersion = BSS_VERSION_CURRENT);
+
+    // Validates block size, fill factor and format version, and takes the block size
+    bool checkCreateOptions(const BSSCreateOptions& options);
+
+    /**
+     * @brief create()/createFromCsv() with everything in memory: parses, sorts and packs.
+     * @param data The source bytes; released once the records are parsed.
+     * @param extents (offset, length) of every record text in data, in input order.
+     */
+    bool createInMemory(const std::string& bssFilename, std::vector<char>& data,
+                        const std::vector<std::pair<size_t, uint32_t>>& extents,
+                        const BSSCreateOptions& options);
+
+    /**
+     * @brief create() under a memory budget: streams the record texts through an ExternalSorter.
+     * @param nextRecordText Points its argument at the next record text; returns false at the end.
+     *        The text only has to stay valid until the next call.
+     */
+    bool createExternal(const std::string& bssFilename,
+                        const std::function<bool(std::string_view&)>& nextRecordText,
+                        const BSSCreateOptions& options);
+
+    // addRecord/deleteRecord bodies, run inside an operation
+    bool insertRecord(const ZipCodeRecordBuffer& record);
+    bool removeRecord(const std::string& zipCode);
+
+    /**
+     * @brief applyChanges for one block, run inside an operation.
+     * @param rbn The block the change at changes[next] belongs to
+     * @param next Advanced past every change that belongs to the block
+     */
+    bool applyBlockChanges(int rbn, const std::vector<Change>& changes, size_t& next, ApplyStats& stats);
+
+    /**
+     * @brief Merges or redistributes a block that fell below minimum capacity.
+     * @param rbn The RBN of the block
+     * @param block The block as written
+     * @return True if successful (also when the block has no neighbour)
+     */
+    bool rebalanceBlock(int rbn, const BSSBlock& block);
+
+    /**
+     * @brief Operation scope for the write-ahead log.
+     * @note Between begin and commit, writeBlock and writeHeader only stage
+     *       the changes (readBlock sees them). Commit logs the header and all
+     *       staged blocks as one record and hands the blocks to the cache;
+     *       abort drops them and restores the header, and returns false.
+     */
+    void beginOperation();
+    bool commitOperation();
+    bool abortOperation();
+
+    // Writes the header, or stages it with the operation when the file is logged
+    bool writeHeader();
+
+    // Syncs the log and forgets which blocks were waiting for it
+    bool syncLog();
+
+
     /**
      * @brief Splits a full block into two blocks.
      * @param fullBlockRBN The RBN of the block to split
@@ -88,25 +411,44 @@ private:
     bool splitBlock(int fullBlockRBN, const ZipCodeRecordBuffer& newRecord);
 
     /**
-     * @brief Finds the correct block to insert a record.
-     * @param zipCode The zip code to search for
+     * @brief Finds the correct block to insert a record (one index probe).
+     * @param key The zip code to search for
      * @return RBN of the block where record should be inserted
      */
-    int findInsertionBlock(const std::string& zipCode);
+    int findInsertionBlock(ZipKey key);
+
+    // Builds the live index from the sequence set if it has not been built yet
+    void ensureIndex();
+
+    /**
+     * @brief Replaces a block's index entry after its contents changed.
+     * @param oldHighestKey The block's highest key before the change
+     * @param rbn The RBN of the block
+     * @param block The block as written
+     */
+    void reindexBlock(ZipKey oldHighestKey, int rbn, const BSSBlock& block);
+
+    /**
+     * @brief Replaces a block's records while keeping its sequence set links.
+     * @param block The block to refill
+     * @param records The records to pack, in key order
+     * @return False if the records do not fit
+     */
+    bool fillBlock(BSSBlock& block, const std::vector<ZipCodeRecordBuffer>& records);
 
     /**
      * @brief Redistributes records between two adjacent blocks.
-     * @param rbn1 The RBN of the first block
-     * @param rbn2 The RBN of the second block
+     * @param rbn1 The RBN of the first block (lower keys)
+     * @param rbn2 The RBN of its successor
      * @return True if successful
      */
     bool redistributeBlocks(int rbn1, int rbn2);
 
     /**
      * @brief Merges two adjacent blocks into one.
-     * @param rbn1 The RBN of the first block
-     * @param rbn2 The RBN of the second block (will be cleared)
-     * @return True if successful
+     * @param rbn1 The RBN of the first block (lower keys)
+     * @param rbn2 The RBN of its successor (will be cleared)
+     * @return True if successful, false (file untouched) if the records do not fit
      */
     bool mergeBlocks(int rbn1, int rbn2);
 
@@ -131,9 +473,48 @@ private:
      */
     uint32_t getMinRecordCount() const;
 
+    // Unmaps the file if it is mapped
+    void unmap();
+
+    // Reads the dictionary chain named by the header (BinaryDictionary files only)
+    bool loadDictionary();
+
+    /**
+     * @brief Writes the dictionary's new entries to its block chain.
+     * @note Only the first block (image header) and the tail change, since
+     *       entries are only ever appended; the chain grows through
+     *       getAvailBlock(). Inside an operation the blocks are logged with it.
+     */
+    bool saveDictionary();
+
     std::fstream file;
+    BlockCache cache;
+    const char* mapping;  // Whole-file mapping in MappedReadOnly mode, else nullptr
+    size_t mappedSize;
+    bool readOnly;        // Set by OpenMode::MappedReadOnly (also on the fstream fallback)
     BSSFileHeader header;
     uint32_t blockSize;
+    BSSIndex index;       // Live highest-key -> RBN index
+    bool indexReady;      // False until the index is built for this file
+    std::string indexPath;  // Index file from loadIndex, written back by close()
+    bool indexDirty;        // Live index changed since it was loaded or saved
+
+    static const size_t DEFAULT_GROUP_COMMIT = 32;
+    static const uint64_t CHECKPOINT_BYTES = 4 * 1024 * 1024;  // Log size that triggers a checkpoint
+
+    WriteAheadLog wal;      // Open in ReadWrite mode only
+    std::string filePath;
+    bool inOperation;
+    BSSFileHeader headerBefore;                  // Restored by abortOperation
+    std::map<int, std::vector<char>> pendingBlocks;  // Staged block images by RBN
+    std::set<int> unsyncedBlocks;                    // Blocks changed by log records not yet synced
+    bool headerDirty;       // In-memory header is ahead of the file's; written by flush()
+    bool lastCloseClean;    // Shutdown marker found by open()
+    size_t groupCommitSize;
+
+    FieldDictionary dictionary;            // State/County codes (BinaryDictionary files)
+    FieldDictionary::Mark dictionaryBefore; // Restored by abortOperation
+    std::vector<int> dictionaryRBNs;       // The dictionary's block chain, in order
 };
 
 #endif // BSSFILE_H
\ No newline at end of file
@@ -5,6 +5,14 @@
 #include <fstream>
 #include <string>
 #include <cstring>
+#include <vector>
+#include "ZipCodeRecordBuffer.h"
+
+// Block format versions, stored in BSSFileHeader::version
+const uint32_t BSS_VERSION_LENGTH_PREFIXED = 1; // [len][record]... , header clipped to one block
+const uint32_t BSS_VERSION_SLOTTED = 2;         // Slot directory + highest key in each block header
+const uint32_t BSS_VERSION_FRONT_CODED = 3;     // Records front-coded against their predecessor, with restart points
+const uint32_t BSS_VERSION_CURRENT = BSS_VERSION_SLOTTED;
 
 /**
  * @brief Manages the master header for the Blocked Sequence Set file.
@@ -15,48 +23,43 @@
  */
 class BSSFileHeader {
 public:
-    BSSFileHeader(uint32_t bSize = 512)
-        : version(1), headerRecordSize(sizeof(BSSFileHeader)),
+    BSSFileHeader(uint32_t bSize = 512, uint32_t formatVersion = BSS_VERSION_CURRENT)
+        : version(formatVersion), headerRecordSize(sizeof(BSSFileHeader)),
           blockSize(bSize), minBlockCapacity(50), recordCount(0),
-          blockCount(0), listHeadRBN(-1), availHeadRBN(-1), stale(false),
+          blockCount(0), listHeadRBN(-1), availHeadRBN(-1), modificationCount(0),
           // NEW fields:
           recordSizeFieldBytes(4),   // 4-byte length integer
           sizeFormatType('B'),       // 'B' = binary, 'A' = ASCII
           fieldCount(6),             // Zip, Place, State, County, Lat, Lon
           primaryKeyFieldIndex(0)    // ZipCode is primary key 
     {
-        // Initialize file structure type string
-        memset(fileStructureType, 0, sizeof(fileStructureType));
-        strncpy(fileStructureType, "BSS_COMMA_LEN_IND", sizeof(fileStructureType) - 1);
-        
+        shutdownState = 0;
+        dictionaryRBN = 0;
+        std::memset(reserved2, 0, sizeof(reserved2));
+
         // Index file name (can be overridden with setter)
         std::memset(indexFileName, 0, sizeof(indexFileName));
         std::strncpy(indexFileName, "data/zip_bss.idx", sizeof(indexFileName) - 1);
 
-        // Initialize field schema arrays
-        std::memset(fieldNames,   0, sizeof(fieldNames));
-        std::memset(fieldTypes,   0, sizeof(fieldTypes));
-        std::memset(fieldFormats, 0, sizeof(fieldFormats));
-
-        setFieldSchema(0, "ZipCode",   "CHAR",   "TEXT");
-        setFieldSchema(1, "PlaceName", "CHAR",   "TEXT");
-        setFieldSchema(2, "State",     "CHAR",   "TEXT");
-        setFieldSchema(3, "County",    "CHAR",   "TEXT");
-        setFieldSchema(4, "Latitude",  "DOUBLE", "NUMERIC");
-        setFieldSchema(5, "Longitude", "DOUBLE", "NUMERIC");
+        // File structure type and field schema (text records until told otherwise)
+        std::memset(fieldNames, 0, sizeof(fieldNames));
+        setRecordEncoding(RecordEncoding::Text);
     }
 
     // Writes the header object directly to the start of the file
     bool write(std::fstream& file) const {
         file.seekp(0, std::ios::beg);
-        // Only write up to blockSize to avoid overwriting block 1
-        size_t writeSize = (sizeof(BSSFileHeader) < blockSize) ? sizeof(BSSFileHeader) : blockSize;
+        // Only write up to the reserved header blocks to avoid overwriting block data
+        size_t regionSize = (size_t)getHeaderBlockCount() * blockSize;
+        size_t writeSize = (sizeof(BSSFileHeader) < regionSize) ? sizeof(BSSFileHeader) : regionSize;
         file.write(reinterpret_cast<const char*>(this), writeSize);
         
-        // If header is smaller than block, pad with zeros
-        if (writeSize < blockSize) {
-            std::vector<char> padding(blockSize - writeSize, 0);
-            file.write(padding.data(), padding.size());
+        // If header is smaller than its blocks, pad with zeros
+        static const char zeros[512] = {};
+        for (size_t left = regionSize - writeSize; left > 0;) {
+            size_t chunk = (left < sizeof(zeros)) ? left : sizeof(zeros);
+            file.write(zeros, chunk);
+            left -= chunk;
         }
         return file.good();
     }
@@ -66,16 +69,58 @@ public:
         file.seekg(0, std::ios::beg);
         // Only read the actual struct size, not the full block
         file.read(reinterpret_cast<char*>(this), sizeof(BSSFileHeader));
+        // Files from before a field was added end earlier; what follows is block data
+        if (file.good() && headerRecordSize < sizeof(BSSFileHeader)) {
+            std::memset(reinterpret_cast<char*>(this) + headerRecordSize, 0,
+                        sizeof(BSSFileHeader) - headerRecordSize);
+        }
         return file.good();
     }
 
+    /**
+     * @brief Number of leading blocks reserved for this header.
+     * @note Version 1 files clip the header to one block (its tail is lost
+     *       when blocks are smaller than the header); later versions
+     *       reserve enough whole blocks for the full header record.
+     */
+    uint32_t getHeaderBlockCount() const {
+        if (version < BSS_VERSION_SLOTTED || blockSize == 0) return 1;
+        return (headerRecordSize + blockSize - 1) / blockSize;
+    }
+
     // --- Accessors and Mutators ---
+    uint32_t getVersion() const { return version; }
     uint32_t getBlockSize() const { return blockSize; }
     uint32_t getRecordCount() const { return recordCount; }
     uint32_t getBlockCount() const { return blockCount; }
     int getListHeadRBN() const { return listHeadRBN; }
     int getAvailHeadRBN() const { return availHeadRBN; }
 
+    /**
+     * @brief Identifies the current state of the sequence set.
+     * @note Combines the modification counter with the counts and list
+     *       heads, so it changes with every insert and delete and also
+     *       differs between two freshly created files. Index files record
+     *       it to say which state of the .bss file they were built from.
+     */
+    uint64_t getGeneration() const {
+        const uint32_t parts[] = {modificationCount, version, blockSize, recordCount, blockCount,
+                                  (uint32_t)listHeadRBN, (uint32_t)availHeadRBN};
+        uint64_t hash = 14695981039346656037ULL;
+        for (uint32_t part : parts) {
+            hash = (hash ^ part) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // Number of inserts and deletes applied since the file was created
+    uint32_t getModificationCount() const { return modificationCount; }
+    void noteModification() { modificationCount++; }
+
+    // Clean-shutdown marker: set while the file is open for writing, cleared by a clean close
+    bool isOpenForWriting() const { return shutdownState == SHUTDOWN_OPEN; }
+    void setOpenForWriting(bool open) { shutdownState = open ? SHUTDOWN_OPEN : SHUTDOWN_CLEAN; }
+
     void setRecordCount(uint32_t count) { recordCount = count; }
     void setBlockCount(uint32_t count) { blockCount = count; }
     void setListHeadRBN(int rbn) { listHeadRBN = rbn; }
@@ -91,6 +136,57 @@ public:
     char getSizeFormatType() const { return sizeFormatType; }
     void setSizeFormatType(char t) { sizeFormatType = t; }
 
+    /**
+     * @brief How records are laid out inside the blocks.
+     * @note Read from the field schema: Latitude stored with format "BINARY"
+     *       selects a binary encoding, its type ("INT32" or "DOUBLE") the
+     *       coordinate width, and State stored as "DICTIONARY" the coded
+     *       variant. Files written before binary records existed carry the
+     *       text schema ("NUMERIC") and decode as Text.
+     */
+    RecordEncoding getRecordEncoding() const {
+        if (std::strcmp(fieldFormats[4], "BINARY") != 0) return RecordEncoding::Text;
+        if (std::strcmp(fieldFormats[2], "DICTIONARY") == 0) return RecordEncoding::BinaryDictionary;
+        return std::strcmp(fieldTypes[4], "INT32") == 0 ? RecordEncoding::BinaryFixed
+                                                         : RecordEncoding::BinaryDouble;
+    }
+
+    // Rewrites the field schema (and structure type) to describe the given encoding
+    void setRecordEncoding(RecordEncoding encoding) {
+        std::memset(fileStructureType, 0, sizeof(fileStructureType));
+        std::memset(fieldTypes, 0, sizeof(fieldTypes));
+        std::memset(fieldFormats, 0, sizeof(fieldFormats));
+        if (encoding == RecordEncoding::Text) {
+            std::strncpy(fileStructureType, "BSS_COMMA_LEN_IND", sizeof(fileStructureType) - 1);
+            setFieldSchema(0, "ZipCode",   "CHAR",   "TEXT");
+            setFieldSchema(1, "PlaceName", "CHAR",   "TEXT");
+            setFieldSchema(2, "State",     "CHAR",   "TEXT");
+            setFieldSchema(3, "County",    "CHAR",   "TEXT");
+            setFieldSchema(4, "Latitude",  "DOUBLE", "NUMERIC");
+            setFieldSchema(5, "Longitude", "DOUBLE", "NUMERIC");
+            return;
+        }
+        const char* coordinateType = (encoding == RecordEncoding::BinaryDouble) ? "DOUBLE" : "INT32";
+        std::strncpy(fileStructureType, "BSS_BINARY_LEN_IND", sizeof(fileStructureType) - 1);
+        setFieldSchema(0, "ZipCode",   "CHAR",         "FIXED");
+        setFieldSchema(1, "PlaceName", "CHAR",         "LEN_PREFIXED");
+        setFieldSchema(2, "State",     "CHAR",         "LEN_PREFIXED");
+        setFieldSchema(3, "County",    "CHAR",         "LEN_PREFIXED");
+        setFieldSchema(4, "Latitude",  coordinateType, "BINARY");
+        setFieldSchema(5, "Longitude", coordinateType, "BINARY");
+        if (encoding == RecordEncoding::BinaryDictionary) {
+            std::strncpy(fileStructureType, "BSS_DICT_LEN_IND", sizeof(fileStructureType) - 1);
+            std::memset(fieldTypes[2], 0, sizeof(fieldTypes[2]) * 2);
+            std::memset(fieldFormats[2], 0, sizeof(fieldFormats[2]) * 2);
+            setFieldSchema(2, "State",  "CODE8",  "DICTIONARY");
+            setFieldSchema(3, "County", "CODE16", "DICTIONARY");
+        }
+    }
+
+    // First block of the State/County dictionary chain; 0 (the header's own RBN) if there is none
+    uint32_t getDictionaryRBN() const { return dictionaryRBN; }
+    void setDictionaryRBN(uint32_t rbn) { dictionaryRBN = rbn; }
+
     // Index file name
     std::string getIndexFileName() const {
         return std::string(indexFileName);
@@ -122,6 +218,9 @@ public:
     void     setPrimaryKeyFieldIndex(uint16_t idx) { primaryKeyFieldIndex = idx; }
 
 private:
+    static const char SHUTDOWN_OPEN = 'O';
+    static const char SHUTDOWN_CLEAN = 'C';
+
     // Helper for setting field schemas
     void setFieldSchema(uint16_t i,
                         const char* name,
@@ -146,13 +245,14 @@ private:
     
     int listHeadRBN;            // RBN of the first block in the active sequence
     int availHeadRBN;           // RBN of the first block in the avail list
-    bool stale;                 // Flag for index validity (not used yet)
+    uint32_t modificationCount; // Bumped by every insert and delete (formerly the unused 'stale' flag)
 
     // Additional fields for header-architecture
     uint32_t recordSizeFieldBytes;   // #bytes in record size int
     char     sizeFormatType;         // 'A' or 'B'
 
     char     indexFileName[64];      // index file name/path
+    char     shutdownState;          // SHUTDOWN_OPEN or SHUTDOWN_CLEAN (0 in older files: unknown)
 
     uint16_t fieldCount;             // how many fields in each record
     uint16_t primaryKeyFieldIndex;   // which field is PK (0 = ZipCode)
@@ -161,6 +261,8 @@ private:
     char fieldNames[6][32];          // names of fields
     char fieldTypes[6][16];          // "CHAR", "DOUBLE", etc.
     char fieldFormats[6][16];        // "TEXT", "NUMERIC", etc.
+    char reserved2[2];               // Explicit padding: the struct is written raw, so no byte may be uninitialized
+    uint32_t dictionaryRBN;          // Head of the 'D' block chain (BinaryDictionary files), 0 = none
 };
 
 #endif // BSSFILEHEADER_H
\ No newline at end of file
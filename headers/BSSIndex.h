@@ -2,10 +2,14 @@
 #define BSSINDEX_H
 
 #include <string>
-#include <map>
+#include <vector>
+#include <utility>
 #include <fstream>
 #include <iostream>
 #include <cstdint>
+#include <memory>
+#include "ZipKey.h"
+#include "IndexFile.h"
 
 // Forward declarations to avoid circular dependency
 class BSSFile;
@@ -17,6 +21,16 @@ class BSSBlock;
  *
  * Maps the highest key in each block to its RBN for efficient searching.
  * This allows binary search through blocks instead of sequential scanning.
+ *
+ * The entries are kept sorted in flat parallel arrays rather than a tree:
+ * keys holds every highest key as a ZipKey (one integer each) and findRBN
+ * runs a branchless binary search over that one contiguous array; rbns
+ * holds the matching block numbers.
+ *
+ * write() stores the two arrays as an IndexFile, and read() maps such a file
+ * and searches it in place: nothing is parsed or copied until the first
+ * setEntry/removeEntry, which copies the entries into private arrays.
+ * Version 1 files (variable-length records) are still read by parsing.
  */
 class BSSIndex {
 public:
@@ -26,19 +40,63 @@ public:
     void build(BSSFile& bssFile);
 
     // Finds the RBN of the block that might contain the given key
-    int findRBN(const std::string& key) const;
+    int findRBN(const std::string& key) const { return findRBN(ZipKey(key)); }
+    int findRBN(ZipKey key) const;
 
-    // Writes the index to a binary file
-    bool write(const std::string& filename) const;
+    // Writes the index to a binary file, tagged with the data file's generation
+    bool write(const std::string& filename, uint64_t sourceGeneration = 0) const;
 
-    // Reads the index from a binary file
+    // Reads the index from a binary file (maps it when it is in the current format)
     bool read(const std::string& filename);
 
+    // Generation of the data file recorded when the index was written (0 if unknown)
+    uint64_t getSourceGeneration() const { return sourceGeneration; }
+
+    // True while entries are served straight from a mapped index file
+    bool isMapped() const { return mapped != nullptr; }
+
     // Dumps the index contents to an output stream
     void dump(std::ostream& os) const;
 
+    // --- Incremental maintenance (used by BSSFile on split/merge/redistribution) ---
+
+    // Removes all entries
+    void clear();
+
+    // Records that the block at rbn now has the given highest key
+    void setEntry(const std::string& highestKey, int rbn) { setEntry(ZipKey(highestKey), rbn); }
+    void setEntry(ZipKey highestKey, int rbn);
+
+    // Removes the entry for highestKey, but only if it still points at rbn
+    void removeEntry(const std::string& highestKey, int rbn) { removeEntry(ZipKey(highestKey), rbn); }
+    void removeEntry(ZipKey highestKey, int rbn);
+
+    size_t size() const { return mapped ? (size_t)mapped->size() : rbns.size(); }
+
+    // Magic of BSSIndex files (see IndexFile)
+    static const char FILE_MAGIC[8];
+
 private:
-    std::map<std::string, int> indexMap;  // Maps highest key -> RBN
+    // Entry arrays: the mapping's while mapped, else the private vectors
+    const ZipKey* keyData() const;
+    const int32_t* rbnData() const;
+
+    // Copies mapped entries into the private vectors so they can change
+    void detach();
+
+    // Parses a version 1 index file
+    bool readLegacy(const std::string& filename);
+
+    // Position of the first entry whose key is >= key (size() if none)
+    size_t lowerBound(ZipKey key) const;
+
+    // Replaces the contents with the given (key, rbn) pairs; a later pair wins over an earlier equal key
+    void assign(std::vector<std::pair<ZipKey, int>>& entries);
+
+    std::vector<ZipKey> keys;   // Search array, ascending
+    std::vector<int32_t> rbns;  // rbns[i] is the block whose highest key is keys[i]
+    std::shared_ptr<const IndexFile> mapped;  // Shared by copies of this index
+    uint64_t sourceGeneration = 0;
 };
 
-#endif // BSSINDEX_H
\ No newline at end of file
+#endif // BSSINDEX_H
@@ -0,0 +1,78 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Timing harnesses for the BSS hot paths, run from the command line.
+ *
+ * Results are printed to stdout. The diagnostic traces of the file classes
+ * are muted while a timed section runs so they do not end up in the numbers.
+ */
+
+/**
+ * @brief Point-lookup throughput: fstream + block cache versus the read-only
+ *        mapping, and the same keys answered by one BSSFile::lookupBatch call.
+ * @param bssFile The sequence set file to query.
+ * @param lookupCount Number of random (existing) keys to look up per mode.
+ */
+void benchmarkLookups(const std::string& bssFile, size_t lookupCount);
+
+/**
+ * @brief Times BSSFile::create for 1, 2, 4, ... maxThreads threads.
+ * @param datFile Project 2.0 .dat input.
+ * @param replicas Every record is repeated this many times to make a larger input.
+ * @param maxThreads Highest thread count tried.
+ * @note Also checks each parallel output is byte-identical to the one-thread file.
+ */
+void benchmarkCreate(const std::string& datFile, unsigned replicas, unsigned maxThreads);
+
+/**
+ * @brief Times the CSV to .dat conversion (processFile) for 1, 2, 4, ... maxThreads threads.
+ * @param csvFile CSV input with a header row.
+ * @param replicas Every data line is repeated this many times to make a larger input.
+ * @param maxThreads Highest thread count tried.
+ * @note Also checks each parallel run writes the same records and index as one thread.
+ */
+void benchmarkConvert(const std::string& csvFile, unsigned replicas, unsigned maxThreads);
+
+/**
+ * @brief Sweeps block size x fill factor at creation time.
+ * @param datFile Project 2.0 .dat input.
+ * @param lookupCount Random existing keys looked up per configuration.
+ * @param insertCount New keys inserted per configuration.
+ * @note Reports file size, lookup latency, insert cost and the number of
+ *       blocks the inserts added (splits).
+ */
+void benchmarkBlockLayout(const std::string& datFile, size_t lookupCount, size_t insertCount);
+
+/**
+ * @brief findRBN cost of the old std::map index against the flat BSSIndex,
+ *        for 10^3, 10^4, ... maxEntries synthetic block keys.
+ * @param maxEntries Largest index size tried.
+ * @param lookupCount Random keys looked up per size.
+ * @note Also checks both indexes return the same RBNs.
+ */
+void benchmarkIndex(size_t maxEntries, size_t lookupCount);
+
+/**
+ * @brief Applying a change set record by record (addRecord/deleteRecord)
+ *        against one BSSFile::applyChanges call, for 100, 1000, ... maxChanges changes.
+ * @param bssFile The sequence set to start from; it is copied, never changed.
+ * @param maxChanges Largest change set tried.
+ * @note Also checks both ways end with the same keys.
+ */
+void benchmarkApplyChanges(const std::string& bssFile, size_t maxChanges);
+
+/**
+ * @brief Record parsing throughput: the old istringstream/std::stod tokenizer
+ *        against ZipCodeRecordBuffer::unpack on string_views with std::from_chars.
+ * @param csvFiles CSV files whose lines are parsed (e.g. Data/us_postal_codes.csv).
+ * @param passes Times every line is parsed per parser.
+ * @note Also checks both parsers accept the same lines and give the same records.
+ */
+void benchmarkParsing(const std::vector<std::string>& csvFiles, unsigned passes);
+
+#endif // BENCHMARK_H
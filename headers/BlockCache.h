@@ -0,0 +1,152 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Decides which unpinned frame of the BlockCache gets evicted.
+ *
+ * Frames are identified by their index in the cache. The cache reports
+ * every access and asks for a victim when it runs out of free frames.
+ */
+class ReplacementPolicy {
+public:
+    virtual ~ReplacementPolicy() = default;
+
+    // Forgets all history and sizes the policy for frameCount frames
+    virtual void reset(size_t frameCount) = 0;
+
+    // Called every time a frame is pinned (hit or freshly loaded)
+    virtual void recordAccess(size_t frame) = 0;
+
+    /**
+     * @brief Picks a frame to evict.
+     * @param isEvictable Returns false for frames that are pinned.
+     * @return Frame index, or -1 if every frame is pinned.
+     */
+    virtual long chooseVictim(const std::function<bool(size_t)>& isEvictable) = 0;
+};
+
+// Evicts the least recently used unpinned frame
+class LRUPolicy : public ReplacementPolicy {
+public:
+    void reset(size_t frameCount) override;
+    void recordAccess(size_t frame) override;
+    long chooseVictim(const std::function<bool(size_t)>& isEvictable) override;
+
+private:
+    std::list<size_t> order;                        // Front = most recently used
+    std::vector<std::list<size_t>::iterator> position;
+    std::vector<bool> tracked;
+};
+
+// Second-chance (CLOCK) approximation of LRU with one reference bit per frame
+class ClockPolicy : public ReplacementPolicy {
+public:
+    void reset(size_t frameCount) override;
+    void recordAccess(size_t frame) override;
+    long chooseVictim(const std::function<bool(size_t)>& isEvictable) override;
+
+private:
+    std::vector<bool> referenced;
+    size_t hand = 0;
+};
+
+/**
+ * @brief Counters used to size the cache for a workload.
+ */
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t writeBacks = 0;   // Dirty frames written to disk
+
+    double hitRatio() const {
+        uint64_t total = hits + misses;
+        return total ? static_cast<double>(hits) / total : 0.0;
+    }
+};
+
+/**
+ * @brief Fixed-capacity buffer pool sitting between BSSFile and its fstream.
+ *
+ * Blocks are pinned into frames, used or modified in place, then unpinned.
+ * Modified frames are marked dirty and written back on eviction or flush().
+ * A pinned frame is never evicted, so the pointer returned by pin() stays
+ * valid until the matching unpin().
+ */
+class BlockCache {
+public:
+    enum class Policy { LRU, CLOCK };
+
+    BlockCache(size_t capacity = 64, Policy policy = Policy::LRU);
+
+    // Binds the cache to an open file, dropping any frames it held
+    void attach(std::fstream* file, uint32_t blockSize);
+
+    // Drops all frames without writing them back
+    void detach();
+
+    /**
+     * @brief Pins block rbn into a frame.
+     * @param rbn The Relative Block Number.
+     * @param loadFromDisk False when the caller overwrites the whole block,
+     *                     which skips the disk read on a miss.
+     * @return Pointer to blockSize bytes, or nullptr on I/O error or if
+     *         every frame is pinned.
+     */
+    char* pin(int rbn, bool loadFromDisk = true);
+
+    // Releases a pin; dirty marks the frame for write-back
+    void unpin(int rbn, bool dirty);
+
+    // Writes all dirty frames back to the file
+    bool flush();
+
+    // Changes capacity/policy; flushes and empties the cache first
+    void configure(size_t capacity, Policy policy);
+
+    /**
+     * @brief Installs a check run before a dirty frame is written to the file.
+     * @param guard Called with the frame's RBN; false fails the write-back
+     *              and keeps the frame dirty.
+     * @note BSSFile uses it to sync its write-ahead log first, so a block never
+     *       reaches the disk ahead of the log record that describes it.
+     */
+    void setWriteBackGuard(std::function<bool(int)> guard) { writeBackGuard = std::move(guard); }
+
+    size_t getCapacity() const { return frames.size(); }
+    Policy getPolicy() const { return policyKind; }
+    const CacheStats& getStats() const { return stats; }
+    void resetStats() { stats = CacheStats(); }
+
+private:
+    struct Frame {
+        int rbn = -1;
+        int pinCount = 0;
+        bool dirty = false;
+        std::vector<char> data;
+    };
+
+    bool writeBack(Frame& frame);
+    long findFrameForLoad();
+
+    std::vector<Frame> frames;
+    std::vector<size_t> freeFrames;
+    std::unordered_map<int, size_t> frameTable;  // RBN -> frame index
+    std::unique_ptr<ReplacementPolicy> policy;
+    Policy policyKind;
+    std::fstream* file;
+    uint32_t blockSize;
+    CacheStats stats;
+    std::function<bool(int)> writeBackGuard;
+};
+
+#endif // BLOCKCACHE_H
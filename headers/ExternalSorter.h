@@ -0,0 +1,100 @@
+#ifndef EXTERNALSORTER_H
+#define EXTERNALSORTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ZipCodeRecordBuffer.h"
+
+/**
+ * @brief Sorts zip code records by key within a fixed memory budget.
+ *
+ * Records are collected with add(). Whenever the collected records would
+ * outgrow the budget they are sorted and spilled to a temporary run file
+ * ([len:uint32][packed record]..., like the Project 2.0 .dat body, but with
+ * records in RUN_ENCODING so coordinates survive the trip exactly). After
+ * finish(), next() returns the records in key order by k-way merging the
+ * runs. If more runs exist than can be merged at once within the budget,
+ * intermediate merge passes combine them first.
+ *
+ * The sort is stable: records with equal keys come out in the order they
+ * were added, which is what the in-memory create path produces.
+ *
+ * @note If nothing was spilled, next() serves the records straight from memory.
+ */
+class ExternalSorter {
+public:
+    // Run files keep full double coordinates, so a spilled record packs like one that never left memory
+    static const RecordEncoding RUN_ENCODING = RecordEncoding::BinaryDouble;
+
+    /**
+     * @param memoryBudget Approximate upper bound on bytes held at once.
+     * @param tempPrefix Run files are named tempPrefix + ".runN.tmp".
+     */
+    ExternalSorter(size_t memoryBudget, const std::string& tempPrefix);
+    ~ExternalSorter();
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    // Adds a record, spilling a sorted run first if the budget is reached
+    bool add(const ZipCodeRecordBuffer& record);
+
+    // Ends input; spills the last run and merges down to one merge pass
+    bool finish();
+
+    // Next record in key order; false when all records were returned
+    bool next(ZipCodeRecordBuffer& out);
+
+    size_t getRecordCount() const { return recordCount; }
+    size_t getRunCount() const { return runsSpilled; }
+
+    // Largest estimated number of bytes held in memory at any time
+    size_t getPeakBytes() const { return peakBytes; }
+
+private:
+    // Sequential reader over one run file
+    struct RunReader {
+        std::ifstream in;
+        std::vector<char> buffer;
+        bool read(ZipCodeRecordBuffer& out);
+    };
+
+    // Entry of the merge heap; ties go to the earlier run
+    struct HeapEntry {
+        ZipCodeRecordBuffer record;
+        size_t run;
+    };
+
+    bool spill();
+    bool mergeRuns(size_t first, size_t last, const std::string& target);
+    bool openMerge(size_t first, size_t last);
+    bool popMerged(ZipCodeRecordBuffer& out);
+    std::string runName(size_t id) const;
+    size_t readBufferBytes(size_t fanIn) const;
+    static size_t estimateBytes(const ZipCodeRecordBuffer& record);
+
+    size_t memoryBudget;
+    size_t fanIn;                      // Runs merged at once
+    std::string tempPrefix;
+
+    std::vector<ZipCodeRecordBuffer> pending;  // Current in-memory run
+    size_t pendingBytes;
+
+    std::vector<std::string> runs;     // Run files still to merge, in input order
+    size_t nextRunId;
+    size_t runsSpilled;
+
+    std::vector<std::unique_ptr<RunReader>> readers;
+    std::vector<HeapEntry> heap;
+    size_t memoryCursor;               // next() position when nothing was spilled
+    bool finished;
+
+    size_t recordCount;
+    size_t peakBytes;
+};
+
+#endif // EXTERNALSORTER_H
@@ -0,0 +1,116 @@
+#ifndef FIELDDICTIONARY_H
+#define FIELDDICTIONARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "ZipCodeRecordBuffer.h"
+
+/**
+ * @brief Per-file dictionaries for the State and County columns.
+ *
+ * Files created with RecordEncoding::BinaryDictionary store each State as
+ * a uint8 code and each County as a uint16 code. Those codes index the
+ * tables kept here. Codes are handed out in first-seen order and never
+ * change or get reused, so a record packed once stays valid while the
+ * tables grow.
+ *
+ * The tables are persisted as one image:
+ *
+ *   [DictionaryImageHeader]                      24 bytes
+ *   [column:uint8][len:uint8][bytes] x entryCount
+ *
+ * Entries are appended in code order, so adding a value only changes the
+ * image header and its tail. BSSFile stores the image in a chain of 'D'
+ * blocks that starts at BSSFileHeader::getDictionaryRBN().
+ */
+struct DictionaryImageHeader {
+    char magic[4];             // "BDIC"
+    uint32_t entryCount;       // Entries of both columns
+    uint64_t payloadBytes;     // Bytes of entries that follow
+    uint64_t checksum;         // IndexFile::checksum() over the entries
+};
+
+class FieldDictionary {
+public:
+    enum Column : uint8_t { STATE = 0, COUNTY = 1 };
+
+    // Restore point for an operation that may be rolled back
+    struct Mark {
+        size_t entries[2];
+        size_t imageBytes;
+    };
+
+    FieldDictionary();
+
+    // Forgets every entry
+    void clear();
+
+    /**
+     * @brief Gives the code for a value, adding the value if it is new.
+     * @param column STATE or COUNTY.
+     * @param value The field text.
+     * @param code Receives the code.
+     * @return False if the column has no codes left (256 states, 65536 counties).
+     */
+    bool encode(Column column, std::string_view value, uint32_t& code);
+
+    // Code of a value that is already in the table, or -1
+    long find(Column column, std::string_view value) const;
+
+    // Value of a code; empty for an unknown code. Stays valid while entries are added
+    std::string_view lookup(Column column, uint32_t code) const {
+        return code < values[column].size() ? std::string_view(values[column][code]) : std::string_view();
+    }
+
+    size_t size(Column column) const { return values[column].size(); }
+
+    /**
+     * @brief Packs a record as [zip][len][place][state:uint8][county:uint16][lat:int32][lon:int32].
+     * @return False if a new State or County value no longer gets a code.
+     * @note Coordinates are fixed point, as in RecordEncoding::BinaryFixed.
+     */
+    bool pack(const ZipCodeRecordBuffer& record, std::string& out);
+
+    /**
+     * @brief Splits a record written by pack() without resolving its codes.
+     * @param text Receives zip and place name (views into packed).
+     * @return False if packed is malformed.
+     */
+    static bool decode(std::string_view packed, std::string_view text[2],
+                       uint32_t& stateCode, uint32_t& countyCode, double& lat, double& lon);
+
+    // --- Persistence ---
+
+    // The image to store; its header is brought up to date first
+    const std::vector<char>& getImage();
+
+    // Bytes of the image; everything from here on is new since markSaved()
+    size_t getSavedBytes() const { return savedBytes; }
+    void markSaved() { savedBytes = image.size(); }
+    bool isDirty() const { return image.size() != savedBytes; }
+
+    /**
+     * @brief Replaces the tables with a stored image.
+     * @param data The image bytes; trailing bytes after the entries are ignored.
+     * @return False if the image is truncated or fails its checksum.
+     */
+    bool load(const char* data, size_t length);
+
+    Mark mark() const;
+    void rollback(const Mark& restorePoint);
+
+private:
+    static const uint32_t MAX_CODES[2];
+
+    std::deque<std::string> values[2];   // Deque: views handed out by lookup() survive appends
+    std::unordered_map<std::string, uint32_t> codes[2];
+    std::vector<char> image;             // Header followed by the entries, in code order
+    size_t savedBytes;
+};
+
+#endif // FIELDDICTIONARY_H
@@ -134,6 +134,16 @@ public:
         return true;
     }
 
+    // Overwrites recordCount in a header that writeHeader() put at headerStart
+    bool rewriteRecordCount(std::ostream& out, std::streampos headerStart) const {
+        std::streampos restore = out.tellp();
+        std::streamoff countOffset = sizeof(uint32_t) + sizeof(fileStructureType) + sizeof(version);
+        out.seekp(headerStart + countOffset);
+        out.write(reinterpret_cast<const char*>(&recordCount), sizeof(recordCount));
+        out.seekp(restore);
+        return static_cast<bool>(out);
+    }
+
     // Getter for record count
     uint64_t getRecordCount() const { return recordCount; }
 };
@@ -0,0 +1,92 @@
+#ifndef INDEXFILE_H
+#define INDEXFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Fixed-record on-disk format shared by BSSIndex and IndexManager.
+ *
+ * Layout (all integers little-endian, every section 8-byte aligned):
+ *
+ *   [IndexFileHeader]                 48 bytes
+ *   [key 0][key 1]...[key n-1]        n x uint64 (ZipKey::value()), ascending
+ *   [value 0]...[value n-1]           n x valueSize bytes (RBN or offset)
+ *
+ * The keys are exactly the array the in-memory indexes binary-search, so a
+ * mapped file is searched in place without deserializing anything. The
+ * checksum covers both sections and is checked when the file is opened.
+ * sourceGeneration records the state of the data file the index was built
+ * from (BSSFileHeader::getGeneration() for .bss files).
+ */
+struct IndexFileHeader {
+    char magic[8];             // Identifies the index kind, e.g. "BSSIDX\0\0"
+    uint32_t version;          // INDEX_FILE_VERSION
+    uint32_t valueSize;        // Bytes per value
+    uint64_t entryCount;
+    uint64_t sourceGeneration; // Generation of the data file at build time
+    uint64_t checksum;         // IndexFile::checksum() over keys and values
+    uint64_t reserved;         // Zero
+};
+
+// Version 1 was the variable-length [count][keyLen][key][value]... stream
+const uint32_t INDEX_FILE_VERSION = 2;
+
+/**
+ * @brief A read-only, memory-mapped index file.
+ * @note Not copyable; indexes share one instance through a shared_ptr.
+ *       Where mmap is unavailable (_WIN32) the file is read into memory.
+ */
+class IndexFile {
+public:
+    IndexFile();
+    ~IndexFile();
+
+    IndexFile(const IndexFile&) = delete;
+    IndexFile& operator=(const IndexFile&) = delete;
+
+    /**
+     * @brief Maps an index file and validates its header and checksum.
+     * @param filename The index file.
+     * @param magic Expected 8-byte magic.
+     * @param valueSize Expected bytes per value.
+     * @return False (with a logged reason) if the file is missing, of another
+     *         kind or version, truncated, or fails its checksum.
+     */
+    bool open(const std::string& filename, const char* magic, uint32_t valueSize);
+
+    // True if the file starts with the given magic (i.e. it is not a version 1 file)
+    static bool hasMagic(const std::string& filename, const char* magic);
+
+    /**
+     * @brief Writes an index file.
+     * @param keys entryCount ascending ZipKey values.
+     * @param values entryCount values of valueSize bytes each.
+     * @return True on success.
+     */
+    static bool write(const std::string& filename, const char* magic,
+                      const uint64_t* keys, const void* values, uint32_t valueSize,
+                      uint64_t entryCount, uint64_t sourceGeneration);
+
+    // 64-bit FNV-1a, fed 8 bytes at a time (tail bytes one by one)
+    static uint64_t checksum(const char* data, size_t length, uint64_t seed = 14695981039346656037ULL);
+
+    const uint64_t* keys() const { return keyData; }
+    const char* values() const { return valueData; }
+    uint64_t size() const { return header.entryCount; }
+    uint64_t getSourceGeneration() const { return header.sourceGeneration; }
+
+private:
+    void release();
+
+    IndexFileHeader header;
+    const char* base;           // Start of the mapping (or of ownedCopy)
+    size_t length;
+    const uint64_t* keyData;
+    const char* valueData;
+    std::vector<char> ownedCopy;  // Used instead of a mapping on _WIN32
+};
+
+#endif // INDEXFILE_H
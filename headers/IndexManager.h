@@ -1,11 +1,15 @@
 #ifndef INDEX_MANAGER_H
 #define INDEX_MANAGER_H
 
-#include <map>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
 #include <cstdint>
 #include <fstream>
 #include <iostream>
+#include "ZipKey.h"
+#include "IndexFile.h"
 
 /**
  * @class IndexManager
@@ -15,10 +19,25 @@
  *  - Scanning a binary data file and extracting ZIP → byte offset mappings.
  *  - Writing this mapping to a compact binary index file.
  *  - Loading the index from disk for fast ZIP code lookups.
+ *
+ * Entries are kept sorted in two parallel arrays (ZipKey values, offsets).
+ * Index files use the IndexFile format; readIndex() maps them and
+ * findOffset() searches the mapping in place. An index built for another
+ * version of the data file (or a version 1 file) is rebuilt on load.
  */
 class IndexManager {
 private:
-    std::map<std::string, uint64_t> indexMap;  ///< Maps ZIP code → file offset
+    std::vector<uint64_t> keys;     ///< ZipKey values, ascending
+    std::vector<uint64_t> offsets;  ///< offsets[i] is the file offset of keys[i]
+    std::shared_ptr<const IndexFile> mapped;  ///< Set while serving a mapped index file
+    uint64_t sourceGeneration = 0;  ///< Size of the data file the index was built from
+    std::vector<std::pair<uint64_t, uint64_t>> pending;  ///< Entries collected since beginBuild()
+
+    const uint64_t* keyData() const { return mapped ? mapped->keys() : keys.data(); }
+    const uint64_t* offsetData() const {
+        return mapped ? reinterpret_cast<const uint64_t*>(mapped->values()) : offsets.data();
+    }
+    void assign(std::vector<std::pair<uint64_t, uint64_t>>& entries);  ///< Sorts; a later duplicate wins
 
 public:
     /**
@@ -27,6 +46,37 @@ public:
      */
     void buildIndex(const std::string& dataFileName);
 
+    /**
+     * @brief Starts an index built record by record while the data file is written.
+     * @note Replaces the current entries once finishBuild() is called.
+     */
+    void beginBuild();
+
+    /**
+     * @brief Indexes one record as buildIndex() would.
+     * @param record The record text (CSV, starting with the ZIP code).
+     * @param offset File offset of the record's length prefix.
+     */
+    void addRecord(std::string_view record, uint64_t offset);
+
+    /**
+     * @brief Adds an entry whose key came from recordKey().
+     */
+    void addEntry(uint64_t key, uint64_t offset) { pending.emplace_back(key, offset); }
+
+    /**
+     * @brief Extracts the ZipKey value of a record's ZIP code.
+     * @return False if the ZIP code is not all digits or is longer than ZipKey::PACKED_BYTES
+     *         (such records are not indexed).
+     */
+    static bool recordKey(std::string_view record, uint64_t& key);
+
+    /**
+     * @brief Sorts the collected entries into the index.
+     * @param dataFileSize Final size in bytes of the data file.
+     */
+    void finishBuild(uint64_t dataFileSize);
+
     /**
      * @brief Writes the in-memory index to a binary file.
      * @param indexFileName Path to the output index file (e.g., "Data/zip.idx").
@@ -34,15 +84,22 @@ public:
     void writeIndex(const std::string& indexFileName) const;
 
     /**
-     * @brief Loads the index from a binary file into memory.
+     * @brief Loads the index from a binary file, rebuilding it if it is stale.
      * @param indexFileName Path to the input index file.
+     * @param dataFileName The data file it indexes; its size must match the one recorded in the index.
      */
-    void readIndex(const std::string& indexFileName);
+    void readIndex(const std::string& indexFileName, const std::string& dataFileName);
+
+    /**
+     * @brief Size in bytes of the data file when the index was built (0 if unknown).
+     */
+    uint64_t getSourceGeneration() const { return sourceGeneration; }
 
     /**
      * @brief Finds the byte offset for a given ZIP code in the index.
      * @param zip The ZIP code to search for.
-     * @return The byte offset in the data file, or UINT64_MAX if not found.
+     * @return The byte offset in the data file, or UINT64_MAX if not found
+     *         (always for codes longer than ZipKey::PACKED_BYTES).
      */
     uint64_t findOffset(const std::string& zip) const;
 
@@ -50,7 +107,9 @@ public:
      * @brief Returns the total number of entries in the index.
      * @return Number of indexed ZIP codes.
      */
-    size_t size() const { return indexMap.size(); }
+    size_t size() const { return mapped ? (size_t)mapped->size() : keys.size(); }
+
+    static const char FILE_MAGIC[8];  ///< Magic of IndexManager files (see IndexFile)
 };
 
 #endif // INDEX_MANAGER_H
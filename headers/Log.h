@@ -0,0 +1,134 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+/**
+ * @brief Level-gated diagnostics for the storage classes (BSSFile, BSSBlock, BSSIndex).
+ *
+ * Every entry has a level, a component tag and a message. The default sink
+ * prints "[component] message" (or just the message when the tag is empty)
+ * to std::cerr for errors and warnings and to std::cout otherwise, which is
+ * what the old direct couts printed. setSink() routes entries elsewhere.
+ *
+ * Two gates keep disabled statements cheap:
+ *  - Compile time: statements above BSS_LOG_COMPILE_LEVEL are compiled out.
+ *    The default is Trace, or Debug when NDEBUG is defined.
+ *  - Run time: statements above the current level cost one integer compare;
+ *    the message is not even formatted. The level starts at Info and can be
+ *    set with setLevel() or the BSS_LOG_LEVEL environment variable
+ *    (error, warn, info, debug, trace).
+ *
+ * Use the LOG_* macros rather than calling write() directly.
+ */
+class Log {
+public:
+    enum class Level : int { Off = 0, Error, Warn, Info, Debug, Trace };
+
+    using Sink = std::function<void(Level, const char* component, const std::string& message)>;
+
+    static Level getLevel() { return static_cast<Level>(level.load(std::memory_order_relaxed)); }
+    static void setLevel(Level newLevel) { level.store(static_cast<int>(newLevel), std::memory_order_relaxed); }
+
+    static bool enabled(Level messageLevel) {
+        return static_cast<int>(messageLevel) <= level.load(std::memory_order_relaxed);
+    }
+
+    // Replaces the output (an empty Sink restores the default console output)
+    static void setSink(Sink newSink) {
+        std::lock_guard<std::mutex> lock(mutex());
+        sink() = std::move(newSink);
+    }
+
+    static void write(Level messageLevel, const char* component, const std::string& message) {
+        std::lock_guard<std::mutex> lock(mutex());
+        if (sink()) {
+            sink()(messageLevel, component, message);
+            return;
+        }
+        std::ostream& out = (messageLevel <= Level::Warn) ? std::cerr : std::cout;
+        if (component && *component) out << '[' << component << "] ";
+        out << message << '\n';
+    }
+
+    // Parses "error", "warn", "info", "debug", "trace" or "off"
+    static bool parseLevel(const std::string& name, Level& out) {
+        static const struct { const char* name; Level level; } names[] = {
+            {"off", Level::Off}, {"error", Level::Error}, {"warn", Level::Warn},
+            {"info", Level::Info}, {"debug", Level::Debug}, {"trace", Level::Trace}
+        };
+        for (const auto& entry : names) {
+            if (name == entry.name) {
+                out = entry.level;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Sets a level for the lifetime of the object, then restores the old one.
+     * @note Handy for benchmarks and bulk operations that would otherwise log per record.
+     */
+    class ScopedLevel {
+    public:
+        explicit ScopedLevel(Level temporary) : saved(getLevel()) { setLevel(temporary); }
+        ~ScopedLevel() { setLevel(saved); }
+    private:
+        Level saved;
+    };
+
+private:
+    static int initialLevel() {
+        Level parsed = Level::Info;
+        const char* env = std::getenv("BSS_LOG_LEVEL");
+        if (env) parseLevel(env, parsed);
+        return static_cast<int>(parsed);
+    }
+
+    static std::mutex& mutex() {
+        static std::mutex m;
+        return m;
+    }
+
+    static Sink& sink() {
+        static Sink s;
+        return s;
+    }
+
+    static std::atomic<int> level;
+};
+
+inline std::atomic<int> Log::level{Log::initialLevel()};
+
+#ifndef BSS_LOG_COMPILE_LEVEL
+#ifdef NDEBUG
+#define BSS_LOG_COMPILE_LEVEL 4 // Debug
+#else
+#define BSS_LOG_COMPILE_LEVEL 5 // Trace
+#endif
+#endif
+
+// message is a stream expression, e.g. LOG_INFO("BSSFile::open", "Opening " << name)
+#define BSS_LOG(lvl, component, message)                                              \
+    do {                                                                             \
+        if (static_cast<int>(lvl) <= BSS_LOG_COMPILE_LEVEL && Log::enabled(lvl)) {   \
+            std::ostringstream bssLogStream;                                         \
+            bssLogStream << message;                                                 \
+            Log::write(lvl, component, bssLogStream.str());                          \
+        }                                                                            \
+    } while (0)
+
+#define LOG_ERROR(component, message) BSS_LOG(Log::Level::Error, component, message)
+#define LOG_WARN(component, message)  BSS_LOG(Log::Level::Warn, component, message)
+#define LOG_INFO(component, message)  BSS_LOG(Log::Level::Info, component, message)
+#define LOG_DEBUG(component, message) BSS_LOG(Log::Level::Debug, component, message)
+#define LOG_TRACE(component, message) BSS_LOG(Log::Level::Trace, component, message)
+
+#endif // LOG_H
@@ -0,0 +1,150 @@
+#ifndef RecordView_H
+#define RecordView_H
+
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <limits>
+#include "ZipCodeRecordBuffer.h"
+#include "FieldDictionary.h"
+
+/**
+ * @brief Read-only, non-owning view of one packed record inside a block buffer.
+ *
+ * Fields are exposed as std::string_view into the block's bytes, so looking
+ * at a record allocates nothing. Latitude/longitude are only parsed when
+ * asked for. Fields are split by ZipCodeRecordBuffer::splitFields, as in
+ * unpack (comma separated, trimmed, surrounding quotes removed, truncated
+ * to the field lengths), and toRecord() produces the same record unpack() would.
+ *
+ * Binary-encoded records (see RecordEncoding) are split by their length
+ * bytes instead, and their coordinates are decoded up front: there is no
+ * text to parse. In dictionary-coded records State and County are only
+ * looked up when asked for; getStateCode() lets a scan filter on the code.
+ *
+ * @note A view is only valid while the block buffer it points into is
+ *       unchanged and alive.
+ */
+class RecordView {
+public:
+    RecordView() = default;
+
+    // Splits a packed record into its fields (no copies)
+    explicit RecordView(std::string_view packedRecord) : payload(packedRecord) {
+        fieldCount = (int)std::min<size_t>(ZipCodeRecordBuffer::splitFields(payload, fields, 6), 6);
+        if (fieldCount == 6) {
+            fields[0] = fields[0].substr(0, ZIP_CODE_LENGTH);
+            fields[1] = fields[1].substr(0, PLACE_NAME_LENGTH);
+            fields[2] = fields[2].substr(0, STATE_LENGTH);
+            fields[3] = fields[3].substr(0, COUNTY_LENGTH);
+        }
+    }
+
+    // Splits a record stored with the given encoding; BinaryDictionary needs the file's dictionary
+    RecordView(std::string_view packedRecord, RecordEncoding encoding,
+               const FieldDictionary* fieldDictionary = nullptr) : RecordView() {
+        if (encoding == RecordEncoding::Text) {
+            *this = RecordView(packedRecord);
+            return;
+        }
+        payload = packedRecord;
+        binary = true;
+        bool ok;
+        if (encoding == RecordEncoding::BinaryDictionary) {
+            dictionary = fieldDictionary;
+            ok = dictionary && FieldDictionary::decode(packedRecord, fields, stateCode, countyCode,
+                                                       latitude, longitude);
+        } else {
+            ok = ZipCodeRecordBuffer::decodeBinary(packedRecord, encoding, fields, latitude, longitude);
+        }
+        if (ok) {
+            fieldCount = 6;
+            latParsed = lonParsed = true;
+        }
+    }
+
+    // True when the payload has all six fields
+    bool isValid() const { return fieldCount == 6; }
+
+    std::string_view getZipCode() const { return fields[0]; }
+    std::string_view getPlaceName() const { return fields[1]; }
+    std::string_view getState() const {
+        return dictionary ? dictionary->lookup(FieldDictionary::STATE, stateCode) : fields[2];
+    }
+    std::string_view getCounty() const {
+        return dictionary ? dictionary->lookup(FieldDictionary::COUNTY, countyCode) : fields[3];
+    }
+
+    // State code in the file's dictionary, or -1 if the record is not dictionary-coded
+    long getStateCode() const { return dictionary ? (long)stateCode : -1; }
+    std::string_view getPayload() const { return payload; }
+
+    // Parsed on first use; NaN if the field is not a number
+    double getLatitude() const {
+        if (!latParsed) {
+            latitude = parseNumber(fields[4]);
+            latParsed = true;
+        }
+        return latitude;
+    }
+
+    double getLongitude() const {
+        if (!lonParsed) {
+            longitude = parseNumber(fields[5]);
+            lonParsed = true;
+        }
+        return longitude;
+    }
+
+    // Copies the record out into an owning record buffer; false if it is malformed
+    bool copyTo(ZipCodeRecordBuffer& rec) const {
+        if (!binary) return rec.unpack(payload);
+        if (!isValid()) return false;
+        if (dictionary) {
+            std::string_view text[4] = {fields[0], fields[1], getState(), getCounty()};
+            rec.assign(text, latitude, longitude);
+        } else {
+            rec.assign(fields, latitude, longitude);
+        }
+        return true;
+    }
+
+    ZipCodeRecordBuffer toRecord() const {
+        ZipCodeRecordBuffer rec;
+        copyTo(rec);
+        return rec;
+    }
+
+    // Same output as ZipCodeRecordBuffer::print
+    void print() const {
+        std::cout << "ZIP: " << fields[0]
+                  << " | Place: " << fields[1]
+                  << " | State: " << getState()
+                  << " | County: " << getCounty()
+                  << " | Lat: " << getLatitude()
+                  << " | Lon: " << getLongitude() << std::endl;
+    }
+
+private:
+    static double parseNumber(std::string_view s) {
+        double value = std::numeric_limits<double>::quiet_NaN();
+        ZipCodeRecordBuffer::parseNumber(s, value);
+        return value;
+    }
+
+    std::string_view payload;
+    std::string_view fields[6];   // Lat/lon text stays empty for binary records
+    int fieldCount = 0;
+    bool binary = false;
+    const FieldDictionary* dictionary = nullptr;  // Set for dictionary-coded records
+    uint32_t stateCode = 0;
+    uint32_t countyCode = 0;
+    mutable double latitude = std::numeric_limits<double>::quiet_NaN();
+    mutable double longitude = std::numeric_limits<double>::quiet_NaN();
+    mutable bool latParsed = false;
+    mutable bool lonParsed = false;
+};
+
+#endif // RecordView_H
@@ -0,0 +1,108 @@
+#ifndef WRITEAHEADLOG_H
+#define WRITEAHEADLOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Redo log that makes multi-block changes to a .bss file atomic.
+ *
+ * Each operation (an insert or delete with any split, merge or
+ * redistribution it causes) is logged as one record holding the after-image
+ * of every byte range it changed:
+ *
+ *   [WalRecordHeader]                          24 bytes
+ *   [WalPageHeader][bytes] x pageCount         offset + length, then the image
+ *
+ * The checksum covers everything after the record header, so a record torn
+ * by a crash is recognised and discarded with everything after it. A record
+ * whose page headers do not add up to its payload is discarded the same way. Replaying
+ * the complete records in order rewrites the file to the state after the
+ * last one; the images are absolute, so replaying twice is harmless.
+ *
+ * Records are buffered and written with one fsync per group of operations
+ * (group commit); a data file page may only reach the disk once the record
+ * that produced it has been synced (see BlockCache::setWriteBackGuard).
+ */
+struct WalRecordHeader {
+    uint32_t magic;            // WAL_RECORD_MAGIC
+    uint32_t pageCount;
+    uint64_t payloadBytes;     // Bytes of pages that follow
+    uint64_t checksum;         // IndexFile::checksum() over the payload
+};
+
+struct WalPageHeader {
+    uint64_t offset;           // Byte offset in the data file
+    uint32_t length;
+    uint32_t reserved;         // Zero
+};
+
+const uint32_t WAL_RECORD_MAGIC = 0x4C415742; // "BWAL"
+
+class WriteAheadLog {
+public:
+    // One byte range to log; data must stay valid until append() returns
+    struct Page {
+        uint64_t offset;
+        const char* data;
+        uint32_t length;
+    };
+
+    WriteAheadLog();
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    /**
+     * @brief Creates an empty log for appending.
+     * @note Call recover() first; a log that still holds records is truncated.
+     */
+    bool open(const std::string& filename);
+
+    // Closes the log without syncing buffered records; remove deletes the file
+    void close(bool remove = false);
+
+    bool isOpen() const { return log != nullptr; }
+
+    // Buffers one operation's pages as a single record
+    void append(const std::vector<Page>& pages);
+
+    // Writes the buffered records and fsyncs the log; no-op if nothing is buffered
+    bool sync();
+
+    // Empties the log once the data file holds every logged change
+    bool reset();
+
+    // Operations appended since the last sync
+    size_t getUnsyncedCount() const { return unsyncedCount; }
+
+    // Bytes in the log, synced or not
+    uint64_t getSize() const { return fileBytes + buffer.size(); }
+
+    /**
+     * @brief Replays a log into its data file, then deletes the log.
+     * @param walFilename The log; a missing or empty log is not an error.
+     * @param dataFilename The .bss file the log belongs to.
+     * @param applied Set to the number of complete records replayed.
+     * @return False if the log could not be read or the file not written.
+     * @note Stops at the first torn or corrupt record; the operations after
+     *       it were never acknowledged as durable and are dropped.
+     */
+    static bool recover(const std::string& walFilename, const std::string& dataFilename, size_t& applied);
+
+    // Forces a file's written data to stable storage
+    static bool syncFile(const std::string& filename);
+
+private:
+    std::FILE* log;
+    std::string path;
+    std::vector<char> buffer;   // Records appended but not yet written
+    size_t unsyncedCount;
+    uint64_t fileBytes;         // Bytes already written to the log file
+};
+
+#endif // WRITEAHEADLOG_H
@@ -8,7 +8,13 @@
 #include <limits>
 #include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
 #include <vector>
+#include "ZipKey.h"
 
 const int ZIP_CODE_LENGTH = 5;
 const int PLACE_NAME_LENGTH = 50;
@@ -16,6 +22,30 @@ const int STATE_LENGTH = 2;
 const int COUNTY_LENGTH = 50;
 const int LAT_LONG_LENGTH = 10;
 
+static_assert(ZIP_CODE_LENGTH <= static_cast<int>(ZipKey::PACKED_BYTES), "Every zip code must pack exactly into a ZipKey");
+
+/**
+ * @brief How a record's fields are stored inside a block.
+ *
+ *  - Text: "zip,place,state,county,lat,lon" as written by pack(); lat/lon
+ *    are printed at default stream precision and parsed back on every read.
+ *  - BinaryFixed / BinaryDouble:
+ *      [zip: ZIP_CODE_LENGTH bytes, NUL-padded]
+ *      [len:uint8][place] [len:uint8][state] [len:uint8][county]
+ *      [lat][lon]
+ *    with lat/lon as int32 millionths of a degree (BinaryFixed) or as
+ *    float64 (BinaryDouble), in host byte order like the rest of the file.
+ *  - BinaryDictionary: like BinaryFixed, but State and County are replaced
+ *    by uint8/uint16 codes into the file's FieldDictionary, which packs
+ *    and decodes these records (pack(encoding) cannot).
+ *
+ * A file's encoding comes from its header schema (BSSFileHeader::getRecordEncoding).
+ */
+enum class RecordEncoding : uint8_t { Text, BinaryFixed, BinaryDouble, BinaryDictionary };
+
+// BinaryFixed coordinates are stored as round(degrees * COORDINATE_SCALE)
+const double COORDINATE_SCALE = 1e6;
+
 class ZipCodeRecordBuffer {
 public:
     ZipCodeRecordBuffer() {
@@ -33,43 +63,86 @@ public:
     return ss.str();
 }
 
-    bool unpack(const std::string& recordString) {
-        std::istringstream ss(recordString);
-        std::vector<std::string> fields;
-        std::string token;
-        
-        try {
-            // Parse CSV with proper quote handling
-            while (std::getline(ss, token, ',')) {
-                trim(token);
-                // Remove surrounding quotes if present
-                if (token.size() >= 2 && token.front() == '"' && token.back() == '"') {
-                    token = token.substr(1, token.size() - 2);
-                    trim(token);
-                }
-                fields.push_back(token);
-            }
-            
-            // Need at least 6 fields
-            if (fields.size() < 6) {
-                return false;
-            }
-            
-            // Assign fields
-            m_fields[0] = truncateTo(fields[0], ZIP_CODE_LENGTH);      // Zip
-            m_fields[1] = truncateTo(fields[1], PLACE_NAME_LENGTH);    // Place
-            m_fields[2] = truncateTo(fields[2], STATE_LENGTH);         // State
-            m_fields[3] = truncateTo(fields[3], COUNTY_LENGTH);        // County
-            
-            // Parse numeric fields
-            latitude = std::stod(fields[4]);   // Lat
-            longitude = std::stod(fields[5]);  // Lon
-            
-            return true;
-        } catch (const std::exception& e) {
-            // Handle error (e.g., bad stod conversion)
+    // Encodes the record for a block; Text gives the same bytes as pack()
+    std::string pack(RecordEncoding encoding) const {
+        if (encoding == RecordEncoding::Text) return pack();
+
+        std::string out;
+        out.reserve(ZIP_CODE_LENGTH + 3 + m_fields[1].size() + m_fields[2].size()
+                    + m_fields[3].size() + 2 * sizeof(double));
+        char zip[ZIP_CODE_LENGTH] = {};
+        std::memcpy(zip, m_fields[0].data(), std::min<size_t>(m_fields[0].size(), ZIP_CODE_LENGTH));
+        out.append(zip, ZIP_CODE_LENGTH);
+        for (int i = 1; i <= 3; ++i) {
+            // unpack/ReadRecord truncate these to at most 50 bytes, so the length fits
+            out.push_back(static_cast<char>(m_fields[i].size()));
+            out.append(m_fields[i]);
+        }
+        appendCoordinate(out, latitude, encoding);
+        appendCoordinate(out, longitude, encoding);
+        return out;
+    }
+
+    /**
+     * @brief Splits a binary-encoded record into its fields without copying.
+     * @param packed The record bytes.
+     * @param encoding BinaryFixed or BinaryDouble.
+     * @param text Receives zip, place, state and county (views into packed).
+     * @return False if packed is too short or its lengths run past the end.
+     */
+    static bool decodeBinary(std::string_view packed, RecordEncoding encoding,
+                             std::string_view text[4], double& lat, double& lon) {
+        size_t coordinateBytes = (encoding == RecordEncoding::BinaryFixed) ? sizeof(int32_t) : sizeof(double);
+        if (packed.size() < ZIP_CODE_LENGTH) return false;
+        text[0] = packed.substr(0, strnlen(packed.data(), ZIP_CODE_LENGTH));
+        size_t pos = ZIP_CODE_LENGTH;
+        for (int i = 1; i <= 3; ++i) {
+            if (pos >= packed.size()) return false;
+            size_t length = static_cast<unsigned char>(packed[pos++]);
+            if (pos + length > packed.size()) return false;
+            text[i] = packed.substr(pos, length);
+            pos += length;
+        }
+        if (pos + 2 * coordinateBytes != packed.size()) return false;
+        lat = readCoordinate(packed.data() + pos, encoding);
+        lon = readCoordinate(packed.data() + pos + coordinateBytes, encoding);
+        return true;
+    }
+
+    // Reverses pack(encoding)
+    bool unpack(std::string_view packed, RecordEncoding encoding) {
+        if (encoding == RecordEncoding::Text) return unpack(packed);
+        std::string_view text[4];
+        double lat, lon;
+        if (!decodeBinary(packed, encoding, text, lat, lon)) return false;
+        assign(text, lat, lon);
+        return true;
+    }
+
+    // Sets every field at once (zip, place, state, county), truncated like unpack()
+    void assign(const std::string_view text[4], double lat, double lon) {
+        m_fields[0].assign(text[0].substr(0, ZIP_CODE_LENGTH));
+        zipKey = ZipKey(m_fields[0]);
+        m_fields[1].assign(text[1].substr(0, PLACE_NAME_LENGTH));
+        m_fields[2].assign(text[2].substr(0, STATE_LENGTH));
+        m_fields[3].assign(text[3].substr(0, COUNTY_LENGTH));
+        latitude = lat;
+        longitude = lon;
+    }
+
+    // Reverses pack(): splits "zip,place,state,county,lat,lon" (extra columns are ignored)
+    bool unpack(std::string_view recordString) {
+        std::string_view fields[6];
+        if (splitFields(recordString, fields, 6) < 6) {
             return false;
         }
+
+        double lat, lon;
+        if (!parseNumber(fields[4], lat) || !parseNumber(fields[5], lon)) {
+            return false;
+        }
+        assign(fields, lat, lon);
+        return true;
     }
 
     // Reads until a valid data record is found or EOF; returns true when a valid record is parsed
@@ -79,84 +152,92 @@ public:
             if (line.empty()) continue;
 
             // parse CSV fields (simple split by comma) - handle up to 7 columns
-            std::vector<std::string> fields;
-            std::istringstream ss(line);
-            std::string token;
-            while (std::getline(ss, token, ',')) {
-                trim(token);
-                // remove surrounding quotes
-                if (token.size() >= 2 && token.front() == '"' && token.back() == '"') {
-                    token = token.substr(1, token.size() - 2);
-                    trim(token);
-                }
-                fields.push_back(token);
-            }
+            std::string_view fields[7];
+            size_t fieldCount = splitFields(line, fields, 7);
 
             // If not 6 or 7 fields, skip line
-            if (fields.size() < 6) continue;
-            if (fields.size() > 7) {
-             // keep first 6 tokens (or merge extras into the last token)
-            fields.resize(6);
+            if (fieldCount < 6) continue;
+            if (fieldCount > 7) {
+                fieldCount = 6; // keep first 6 tokens
             }
             bool hasRecordLength = false;
             // Detect optional RecordLength field: treat as numeric integer (all digits)
-            if (fields.size() == 7) {
-                const std::string &f0 = fields[0];
+            if (fieldCount == 7) {
+                std::string_view f0 = fields[0];
                 bool allDigits = !f0.empty() && std::all_of(f0.begin(), f0.end(), [](unsigned char c){
                     return std::isdigit(c);
                 });
                 if (allDigits) hasRecordLength = true;
-                else {
-                    // maybe header with "RecordLength" text: skip header
-                    std::string up0 = f0;
-                    std::transform(up0.begin(), up0.end(), up0.begin(), [](unsigned char c){ return std::toupper(c); });
-                    if (up0.find("RECORD") != std::string::npos) continue;
-                    // otherwise, accept as 7th field but treat as not record length (rare)
-                }
+                // maybe header with "RecordLength" text: skip header
+                else if (containsIgnoreCase(f0, "RECORD")) continue;
+                // otherwise, accept as 7th field but treat as not record length (rare)
             }
 
-            // Determine indices for fields: if hasRecordLength, zip is fields[1], else fields[0]
-            int zipId = hasRecordLength ? 1 : 0;
-            int placeId = zipId + 1;
-            int stateId = zipId + 2;
-            int countyId = zipId + 3;
-            int latId = zipId + 4;
-            int lonId = zipId + 5;
+            // If hasRecordLength, zip is fields[1], else fields[0]; the other five follow it
+            const std::string_view* record = fields + (hasRecordLength ? 1 : 0);
 
             // Basic header detection: if zip field contains "ZIP" or "POSTAL", skip
-            std::string zipCandidate = fields[zipId];
-            std::string upZip = zipCandidate;
-            std::transform(upZip.begin(), upZip.end(), upZip.begin(), [](unsigned char c){ return std::toupper(c); });
-            if (upZip.find("ZIP") != std::string::npos || upZip.find("POSTAL") != std::string::npos) {
+            if (containsIgnoreCase(record[0], "ZIP") || containsIgnoreCase(record[0], "POSTAL")) {
                 continue;
             }
 
-            // Now map into m_fields (we always keep 6 logical fields)
-            m_fields[0] = truncateTo(fields[zipId], ZIP_CODE_LENGTH);
-            m_fields[1] = truncateTo(fields[placeId], PLACE_NAME_LENGTH);
-            m_fields[2] = truncateTo(fields[stateId], STATE_LENGTH);
-            m_fields[3] = truncateTo(fields[countyId], COUNTY_LENGTH);
-            std::string latStr = truncateTo(fields[latId], LAT_LONG_LENGTH);
-            std::string lonStr = truncateTo(fields[lonId], LAT_LONG_LENGTH);
-
-            // Try converting lat/lon
-            try {
-                // std::stod tolerates leading/trailing spaces
-                latitude = std::stod(latStr);
-                longitude = std::stod(lonStr);
-            } catch (...) {
-                // malformed numeric fields -> skip line
+            // malformed numeric fields -> skip line
+            double lat, lon;
+            if (!parseNumber(record[4].substr(0, LAT_LONG_LENGTH), lat) ||
+                !parseNumber(record[5].substr(0, LAT_LONG_LENGTH), lon)) {
                 continue;
             }
 
             // success
+            assign(record, lat, lon);
             return true;
         }
         // EOF reached without a valid data record
         return false;
     }
 
+    /**
+     * @brief Splits a comma-separated line into fields without copying.
+     * @param line The text to split.
+     * @param fields Receives the first maxFields fields (views into line).
+     * @param maxFields Capacity of fields.
+     * @return Number of fields in the line, which may be more than maxFields.
+     * @note Each field is trimmed, and one pair of surrounding quotes is
+     *       removed (then trimmed again). Quotes do not protect commas, and
+     *       a trailing comma adds no empty field, as with std::getline.
+     */
+    static size_t splitFields(std::string_view line, std::string_view* fields, size_t maxFields) {
+        size_t count = 0;
+        size_t start = 0;
+        while (start < line.size()) {
+            size_t comma = line.find(',', start);  // memchr, vectorized by the C library
+            size_t end = (comma == std::string_view::npos) ? line.size() : comma;
+            if (count < maxFields) {
+                fields[count] = cleanField(line.substr(start, end - start));
+            }
+            count++;
+            if (comma == std::string_view::npos) break;
+            start = comma + 1;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Parses a number like std::stod: longest numeric prefix, optional '+'.
+     * @param text The field text, already trimmed.
+     * @param value Receives the number; untouched on failure.
+     * @return False if text does not start with a number or it is out of range.
+     */
+    static bool parseNumber(std::string_view text, double& value) {
+        if (!text.empty() && text.front() == '+') {
+            text.remove_prefix(1);
+            if (!text.empty() && text.front() == '-') return false;
+        }
+        return std::from_chars(text.data(), text.data() + text.size(), value).ec == std::errc();
+    }
+
     std::string getZipCode() const { return m_fields[0]; }
+    ZipKey getZipKey() const { return zipKey; }  // Integer form of the zip code, for sorting
     std::string getPlaceName() const { return m_fields[1]; }
     std::string getState() const { return m_fields[2]; }
     std::string getCounty() const { return m_fields[3]; }
@@ -175,21 +256,52 @@ public:
 
 private:
     std::string m_fields[6];
+    ZipKey zipKey;  // Kept in step with m_fields[0]
     double latitude = std::numeric_limits<double>::quiet_NaN();
     double longitude = std::numeric_limits<double>::quiet_NaN();
 
-    static inline void trim(std::string &s) {
-        s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) {
-            return !std::isspace(ch);
-        }));
-        s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) {
-            return !std::isspace(ch);
-        }).base(), s.end());
+    // Trims a field and strips one pair of surrounding quotes
+    static std::string_view cleanField(std::string_view s) {
+        s = trim(s);
+        if (s.size() >= 2 && s.front() == '"' && s.back() == '"') {
+            s = trim(s.substr(1, s.size() - 2));
+        }
+        return s;
+    }
+
+    static std::string_view trim(std::string_view s) {
+        while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+        while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+        return s;
+    }
+
+    static bool containsIgnoreCase(std::string_view text, std::string_view word) {
+        return std::search(text.begin(), text.end(), word.begin(), word.end(), [](char a, char b) {
+            return std::toupper(static_cast<unsigned char>(a)) == std::toupper(static_cast<unsigned char>(b));
+        }) != text.end();
     }
 
-    static inline std::string truncateTo(const std::string &s, size_t maxLen) {
-        if (s.length() <= maxLen) return s;
-        return s.substr(0, maxLen);
+    static void appendCoordinate(std::string& out, double value, RecordEncoding encoding) {
+        if (encoding == RecordEncoding::BinaryFixed) {
+            // INT32_MIN is outside +-180 degrees and stands for "no value"
+            int32_t fixed = std::isfinite(value) && std::fabs(value) * COORDINATE_SCALE < 2147483647.0
+                                ? static_cast<int32_t>(std::lround(value * COORDINATE_SCALE))
+                                : INT32_MIN;
+            out.append(reinterpret_cast<const char*>(&fixed), sizeof(fixed));
+        } else {
+            out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+    }
+
+    static double readCoordinate(const char* data, RecordEncoding encoding) {
+        if (encoding == RecordEncoding::BinaryFixed) {
+            int32_t fixed;
+            std::memcpy(&fixed, data, sizeof(fixed));
+            return fixed == INT32_MIN ? std::numeric_limits<double>::quiet_NaN() : fixed / COORDINATE_SCALE;
+        }
+        double value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
     }
 };
 
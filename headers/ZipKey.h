@@ -0,0 +1,79 @@
+#ifndef ZIPKEY_H
+#define ZIPKEY_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Compact, order-preserving form of a zip code key.
+ *
+ * The key's bytes are packed big-endian into the top PACKED_BYTES bytes of a
+ * uint64 and zero-padded, so two ZipKeys compare with one integer compare in
+ * the same order as their strings. Records truncate their zip code to
+ * ZIP_CODE_LENGTH (5) characters, so every stored key, numeric or
+ * alphanumeric, packs exactly and nothing needs an escape to a string.
+ *
+ * A search key longer than PACKED_BYTES keeps its prefix and sets the low
+ * "overlong" byte: it sorts after every key that is a prefix of it, as the
+ * string would, and never equals a stored key.
+ *
+ * @note Keys must not contain NUL bytes (the padding value).
+ */
+class ZipKey {
+public:
+    static const size_t PACKED_BYTES = 7;
+
+    ZipKey() : packed(0) {}
+    explicit ZipKey(std::string_view key) : packed(pack(key.data(), key.size())) {}
+
+    // Key held in a NUL-padded fixed-width field (slot directory, block header)
+    static ZipKey fromField(const char* field, size_t width) {
+        ZipKey key;
+        key.packed = pack(field, strnlen(field, width));
+        return key;
+    }
+
+    // Inverse of value(), for keys stored as raw integers (e.g. in an index file)
+    static ZipKey fromValue(uint64_t value) {
+        ZipKey key;
+        key.packed = value;
+        return key;
+    }
+
+    std::string toString() const {
+        std::string key;
+        for (size_t i = 0; i < PACKED_BYTES; ++i) {
+            char c = static_cast<char>(packed >> (8 * (7 - i)));
+            if (c == '\0') break;
+            key.push_back(c);
+        }
+        return key;
+    }
+
+    bool empty() const { return packed == 0; }
+    uint64_t value() const { return packed; }
+
+    bool operator==(ZipKey other) const { return packed == other.packed; }
+    bool operator!=(ZipKey other) const { return packed != other.packed; }
+    bool operator<(ZipKey other) const { return packed < other.packed; }
+    bool operator<=(ZipKey other) const { return packed <= other.packed; }
+    bool operator>(ZipKey other) const { return packed > other.packed; }
+    bool operator>=(ZipKey other) const { return packed >= other.packed; }
+
+private:
+    static uint64_t pack(const char* data, size_t length) {
+        uint64_t value = 0;
+        for (size_t i = 0; i < PACKED_BYTES; ++i) {
+            value = (value << 8) | (i < length ? static_cast<unsigned char>(data[i]) : 0u);
+        }
+        value <<= 8;
+        if (length > PACKED_BYTES) value |= 1;  // Overlong marker
+        return value;
+    }
+
+    uint64_t packed;
+};
+
+#endif // ZIPKEY_H
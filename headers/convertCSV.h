@@ -7,7 +7,18 @@
 #include <string>
 
 void lenRead(std::ofstream& output, const std::string& record);
-void processFile(std::string& inputFileName, const std::string& outputFileName);
+
+/**
+ * @brief Converts a CSV file into a length-prefixed .dat file and writes its ZIP index.
+ * @param threads Parser threads (0 = one per hardware thread, 1 = no extra threads).
+ *        The output is the same for every thread count.
+ * @param indexFileName Where the index goes; also recorded in the .dat header.
+ * @note With more than one thread a reader thread cuts the input into chunks of
+ *       whole lines, the parsers format them, and the calling thread writes
+ *       them in input order with one write per chunk.
+ */
+void processFile(std::string& inputFileName, const std::string& outputFileName, unsigned threads = 0,
+                 const std::string& indexFileName = "Data/zip.idx");
 void binaryToCSV();
 
 
@@ -1,27 +1,49 @@
 #include "../headers/BSSBlock.h"
+#include "../headers/Log.h"
+#include <algorithm>
 #include <cstring> // For memcpy, memset
 #include <string>
+#include <string_view>
 #include <vector>
 
-BSSBlock::BSSBlock(uint32_t bSize) : blockSize(bSize), buffer(nullptr), highestKey("") {
+static_assert(sizeof(BSSBlock::BlockHeader) == 24, "BlockHeader is written raw; restartCount must stay in its padding");
+
+BSSBlock::BSSBlock(uint32_t bSize, uint32_t version, RecordEncoding encoding, FieldDictionary* fieldDictionary)
+    : blockSize(bSize), formatVersion(version), recordEncoding(encoding), dictionary(fieldDictionary), buffer(nullptr), ownsBuffer(true), highestKey(), expandedValid(false) {
     buffer = new char[blockSize];
     clear();
 }
 
 BSSBlock::~BSSBlock() {
-    delete[] buffer;
+    if (ownsBuffer) delete[] buffer;
+}
+
+// Gives the block a private buffer of blockSize bytes, keeping its contents
+void BSSBlock::ensureOwned() {
+    if (ownsBuffer) return;
+    char* copy = new char[blockSize];
+    memcpy(copy, buffer, blockSize);
+    buffer = copy;
+    ownsBuffer = true;
 }
 
 // Initializes block to an empty, active state
 void BSSBlock::clear() {
+    ensureOwned();
     memset(buffer, 0, blockSize);
     BlockHeader* header = getHeader();
     header->recordCount = 0;
     header->successorRBN = -1;
     header->predecessorRBN = -1;
     header->blockType = 'A';  // Active block
-    currentSize = sizeof(BlockHeader);
-    highestKey = "";
+    if (isSlotted()) {
+        header->dataStart = (uint16_t)blockSize;
+    } else if (isFrontCoded()) {
+        header->dataStart = (uint16_t)sizeof(BlockHeader);
+    }
+    currentSize = headerSize();
+    highestKey = ZipKey();
+    expandedValid = false;
 }
 
 /**
@@ -30,18 +52,41 @@ void BSSBlock::clear() {
  * @note Avail blocks have recordCount == 0 and are filled with blanks (spaces)
  */
 void BSSBlock::makeAvailBlock(int nextAvailRBN) {
+    ensureOwned();
     // Fill entire buffer with blanks (spaces) as per specification
     memset(buffer, ' ', blockSize);
-    
+
     // Set header for avail block
     BlockHeader* header = getHeader();
     header->recordCount = 0;              // Must be 0 for avail blocks
     header->successorRBN = nextAvailRBN;  // Link to next avail block
     header->predecessorRBN = -1;          // Not used in avail list
     header->blockType = 'V';              // 'V' = aVail block
-    
-    currentSize = sizeof(BlockHeader);
-    highestKey = "";
+
+    currentSize = headerSize();
+    highestKey = ZipKey();
+    expandedValid = false;
+}
+
+/**
+ * @brief Turns this block into one link of a file's dictionary chain.
+ * @param nextRBN The next block of the chain (-1 if this is the last).
+ * @param data Up to getDictionaryCapacity() bytes of the dictionary image.
+ */
+void BSSBlock::makeDictionaryBlock(int nextRBN, const char* data, uint32_t length) {
+    ensureOwned();
+    memset(buffer, 0, blockSize);
+
+    BlockHeader* header = getHeader();
+    header->recordCount = 0;
+    header->successorRBN = nextRBN;
+    header->predecessorRBN = -1;
+    header->blockType = 'D';  // 'D' = Dictionary block
+    memcpy(buffer + LENGTH_PREFIXED_HEADER_SIZE, data, std::min(length, getDictionaryCapacity()));
+
+    currentSize = headerSize();
+    highestKey = ZipKey();
+    expandedValid = false;
 }
 
 /**
@@ -50,9 +95,54 @@ void BSSBlock::makeAvailBlock(int nextAvailRBN) {
  * @return True if the record fit, false otherwise.
  */
 bool BSSBlock::addRecord(const ZipCodeRecordBuffer& record) {
-    std::string packedRecord = record.pack();
+    return addRecord(record, getCapacityBytes());
+}
+
+bool BSSBlock::addRecord(const ZipCodeRecordBuffer& record, uint32_t usedBytesLimit) {
+    ensureOwned();
+    std::string packedRecord;
+    if (recordEncoding != RecordEncoding::BinaryDictionary) {
+        packedRecord = record.pack(recordEncoding);
+    } else if (!dictionary || !dictionary->pack(record, packedRecord)) {
+        return false;
+    }
+    std::string zip = record.getZipCode();
+    ZipKey key = record.getZipKey();
+
+    bool added;
+    if (isFrontCoded()) {
+        // Entry sizes depend on the neighbours, so the limit is checked while encoding
+        added = addRecordFrontCoded(packedRecord, key, usedBytesLimit);
+    } else {
+        // A fill limit never keeps the first record out of an empty block
+        uint32_t used = getUsedBytes();
+        uint32_t overhead = isSlotted() ? SLOT_SIZE : sizeof(uint16_t);
+        if (used > 0 && used + overhead + packedRecord.length() > usedBytesLimit) {
+            return false;
+        }
+        added = isSlotted() ? addRecordSlotted(packedRecord, zip, key)
+                            : addRecordLengthPrefixed(packedRecord);
+    }
+    if (!added) {
+        return false;
+    }
+
+    // Update block header and highest key
+    getHeader()->recordCount++;
+    if (key > highestKey) {
+        highestKey = key;
+        if (hasKeyedHeader()) {
+            BlockHeader* header = getHeader();
+            memset(header->highestKey, 0, sizeof(header->highestKey));
+            memcpy(header->highestKey, zip.data(), zip.size());
+        }
+    }
+    return true;
+}
+
+bool BSSBlock::addRecordLengthPrefixed(const std::string& packedRecord) {
     uint16_t recordLen = (uint16_t)packedRecord.length();
-    
+
     // Check if it fits (Record Length + Record Data)
     if (currentSize + sizeof(recordLen) + recordLen > blockSize) {
         return false;
@@ -67,16 +157,413 @@ bool BSSBlock::addRecord(const ZipCodeRecordBuffer& record) {
     writePos = buffer + currentSize;
     memcpy(writePos, packedRecord.c_str(), recordLen);
     currentSize += recordLen;
+    return true;
+}
 
-    // Update block header and highest key
-    getHeader()->recordCount++;
-    std::string zip = record.getZipCode();
-    if (zip > highestKey) {
-        highestKey = zip;
+bool BSSBlock::addRecordSlotted(const std::string& packedRecord, const std::string& zip, ZipKey key) {
+    BlockHeader* header = getHeader();
+    uint32_t count = header->recordCount;
+    uint16_t recordLen = (uint16_t)packedRecord.length();
+
+    // Check if it fits (Slot + Record Data) between the slot directory and the data
+    uint32_t slotEnd = sizeof(BlockHeader) + count * SLOT_SIZE;
+    if (slotEnd + SLOT_SIZE + recordLen > header->dataStart) {
+        return false;
+    }
+
+    // Write data at the back
+    header->dataStart = (uint16_t)(header->dataStart - recordLen);
+    memcpy(buffer + header->dataStart, packedRecord.data(), recordLen);
+
+    // Insert the slot after any equal keys to keep the directory sorted
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (slotKey(mid) <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    memmove(slotAt(lo + 1), slotAt(lo), (count - lo) * SLOT_SIZE);
+
+    char* slot = slotAt(lo);
+    uint16_t offset = header->dataStart;
+    memcpy(slot, &offset, sizeof(offset));
+    memcpy(slot + sizeof(uint16_t), &recordLen, sizeof(recordLen));
+    memset(slot + 2 * sizeof(uint16_t), 0, ZIP_CODE_LENGTH);
+    memcpy(slot + 2 * sizeof(uint16_t), zip.data(), std::min<size_t>(zip.size(), ZIP_CODE_LENGTH));
+    return true;
+}
+
+bool BSSBlock::addRecordFrontCoded(const std::string& packedRecord, ZipKey key, uint32_t usedBytesLimit) {
+    BlockHeader* header = getHeader();
+    uint32_t count = header->recordCount;
+    expand();
+    if (expandedRecords.size() != count) {
+        return false;  // Damaged entries; re-encoding would lose the records after them
+    }
+
+    // The records after a new one would need new prefixes, so only the highest key is appended in place
+    if (count > 0 && key < highestKey) {
+        std::vector<std::string> records;
+        std::vector<bool> restarts;
+        records.reserve(count + 1);
+        bool inserted = false;
+        for (const DecodedRecord& decoded : expandedRecords) {
+            std::string_view record(expanded.data() + decoded.offset, decoded.length);
+            if (!inserted && key < keyPartKey(record.substr(0, keyPartLength(record)))) {
+                records.push_back(packedRecord);
+                inserted = true;
+            }
+            records.emplace_back(record);
+        }
+        for (size_t i = 0; i < records.size(); ++i) {
+            restarts.push_back(i % RESTART_INTERVAL == 0);
+        }
+        return rewriteFrontCoded(records, restarts, usedBytesLimit);
+    }
+
+    // Start a new group once the last one is full
+    uint32_t groupSize = 0;
+    while (groupSize < count && !expandedRecords[count - 1 - groupSize].restart) groupSize++;
+    bool restart = (count == 0 || groupSize + 1 >= RESTART_INTERVAL);
+
+    std::string_view previous;
+    if (!restart) {
+        const DecodedRecord& last = expandedRecords.back();
+        previous = std::string_view(expanded.data() + last.offset, last.length);
+    }
+    uint32_t entrySize = encodeEntry(nullptr, previous, packedRecord);
+    if (entrySize == 0) {
+        return false;
+    }
+
+    // A fill limit never keeps the first record out of an empty block
+    uint32_t used = getUsedBytes();
+    uint32_t newUsed = used + entrySize + (restart ? sizeof(uint16_t) : 0);
+    if ((used > 0 && newUsed > usedBytesLimit) || newUsed > getCapacityBytes()) {
+        return false;
+    }
+
+    if (restart) {
+        uint16_t offset = header->dataStart;
+        header->restartCount++;
+        memcpy(buffer + blockSize - header->restartCount * sizeof(uint16_t), &offset, sizeof(offset));
+    }
+    encodeEntry(buffer + header->dataStart, previous, packedRecord);
+    header->dataStart = (uint16_t)(header->dataStart + entrySize);
+
+    expandedRecords.push_back({(uint32_t)expanded.size(), (uint32_t)packedRecord.size(), restart});
+    expanded += packedRecord;
+    return true;
+}
+
+/**
+ * @brief Encodes records (in key order) as the block's entries, if they fit.
+ * @param restarts Which records to store in full; the first must be one.
+ * @param usedBytesLimit Maximum getUsedBytes() afterwards.
+ * @note Leaves recordCount and the highest key to the caller.
+ */
+bool BSSBlock::rewriteFrontCoded(const std::vector<std::string>& records, const std::vector<bool>& restarts,
+                                 uint32_t usedBytesLimit) {
+    uint32_t used = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        std::string_view previous = restarts[i] ? std::string_view() : std::string_view(records[i - 1]);
+        uint32_t entrySize = encodeEntry(nullptr, previous, records[i]);
+        if (entrySize == 0) return false;
+        used += entrySize + (restarts[i] ? sizeof(uint16_t) : 0);
+    }
+    if (used > usedBytesLimit || used > getCapacityBytes()) {
+        return false;
+    }
+
+    BlockHeader* header = getHeader();
+    uint32_t pos = sizeof(BlockHeader);
+    header->restartCount = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        std::string_view previous;
+        if (restarts[i]) {
+            uint16_t offset = (uint16_t)pos;
+            header->restartCount++;
+            memcpy(buffer + blockSize - header->restartCount * sizeof(uint16_t), &offset, sizeof(offset));
+        } else {
+            previous = records[i - 1];
+        }
+        pos += encodeEntry(buffer + pos, previous, records[i]);
+    }
+    header->dataStart = (uint16_t)pos;
+    expandedValid = false;
+    return true;
+}
+
+/**
+ * @brief Removes a record, keeping every other restart point.
+ * @note The successor of the removed record shares at least as much with
+ *       its new predecessor as the smaller of its two old shared prefixes,
+ *       so its entry grows by less than the removed entry's size; a removed
+ *       restart point hands its role to its successor the same way.
+ */
+bool BSSBlock::removeRecordFrontCoded(ZipKey key) {
+    BlockHeader* header = getHeader();
+    expand();
+    if (expandedRecords.size() != header->recordCount) {
+        return false;
+    }
+
+    std::vector<std::string> records;
+    std::vector<bool> restarts;
+    records.reserve(expandedRecords.size());
+    bool removed = false;
+    bool promote = false;  // The removed record was a restart point
+    for (const DecodedRecord& decoded : expandedRecords) {
+        std::string_view record(expanded.data() + decoded.offset, decoded.length);
+        if (!removed && keyPartKey(record.substr(0, keyPartLength(record))) == key) {
+            removed = true;
+            promote = decoded.restart;
+            continue;
+        }
+        records.emplace_back(record);
+        restarts.push_back(decoded.restart || promote);
+        promote = false;
+    }
+    if (!removed || !rewriteFrontCoded(records, restarts, getCapacityBytes())) {
+        return false;
+    }
+
+    header->recordCount--;
+    highestKey = ZipKey();
+    memset(header->highestKey, 0, sizeof(header->highestKey));
+    if (!records.empty()) {
+        const std::string& last = records.back();
+        std::string_view keyPart(last.data(), keyPartLength(last));
+        highestKey = keyPartKey(keyPart);
+        std::string zip = highestKey.toString();
+        memcpy(header->highestKey, zip.data(), zip.size());
+    }
+    return true;
+}
+
+uint16_t BSSBlock::restartOffset(uint32_t i) const {
+    uint16_t offset;
+    memcpy(&offset, buffer + blockSize - (i + 1) * sizeof(uint16_t), sizeof(offset));
+    return offset;
+}
+
+// Length of a packed record's key part: the zip field (and its comma in text records)
+size_t BSSBlock::keyPartLength(std::string_view packedRecord) const {
+    if (recordEncoding != RecordEncoding::Text) {
+        return std::min<size_t>(packedRecord.size(), ZIP_CODE_LENGTH);
+    }
+    size_t comma = packedRecord.find(',');
+    return comma == std::string_view::npos ? packedRecord.size() : comma + 1;
+}
+
+ZipKey BSSBlock::keyPartKey(std::string_view keyPart) const {
+    if (recordEncoding != RecordEncoding::Text) {
+        return ZipKey::fromField(keyPart.data(), keyPart.size());
+    }
+    if (!keyPart.empty() && keyPart.back() == ',') keyPart.remove_suffix(1);
+    return ZipKey(keyPart);
+}
+
+/**
+ * @brief Front-codes a record against the one before it.
+ * @param out Receives the entry; nullptr only measures it.
+ * @param previous The preceding record, or empty for a restart point.
+ * @return Entry size in bytes, or 0 if an unshared part is longer than 255 bytes.
+ */
+uint32_t BSSBlock::encodeEntry(char* out, std::string_view previous, std::string_view record) const {
+    size_t keyLength = keyPartLength(record);
+    size_t previousKeyLength = keyPartLength(previous);
+    std::string_view parts[2] = {record.substr(0, keyLength), record.substr(keyLength)};
+    std::string_view previousParts[2] = {previous.substr(0, previousKeyLength), previous.substr(previousKeyLength)};
+
+    size_t shared[2];
+    for (int i = 0; i < 2; ++i) {
+        size_t limit = std::min<size_t>({parts[i].size(), previousParts[i].size(), UINT8_MAX});
+        shared[i] = 0;
+        while (shared[i] < limit && parts[i][shared[i]] == previousParts[i][shared[i]]) shared[i]++;
+        if (parts[i].size() - shared[i] > UINT8_MAX) return 0;
+    }
+
+    size_t keyBytes = parts[0].size() - shared[0];
+    size_t restBytes = parts[1].size() - shared[1];
+    if (out) {
+        out[0] = static_cast<char>(shared[0]);
+        out[1] = static_cast<char>(keyBytes);
+        out[2] = static_cast<char>(shared[1]);
+        out[3] = static_cast<char>(restBytes);
+        memcpy(out + ENTRY_HEADER_SIZE, parts[0].data() + shared[0], keyBytes);
+        memcpy(out + ENTRY_HEADER_SIZE + keyBytes, parts[1].data() + shared[1], restBytes);
+    }
+    return (uint32_t)(ENTRY_HEADER_SIZE + keyBytes + restBytes);
+}
+
+/**
+ * @brief Decodes the entry at pos on top of the previous record's parts.
+ * @param pos Entry offset; advanced past the entry.
+ * @param key,rest Hold the previous record's parts and receive this one's.
+ * @return False if the entry runs past end or shares more than the previous record has.
+ */
+bool BSSBlock::decodeEntry(uint32_t& pos, uint32_t end, std::string& key, std::string& rest) const {
+    if (pos + ENTRY_HEADER_SIZE > end) return false;
+    const unsigned char* entry = reinterpret_cast<const unsigned char*>(buffer + pos);
+    uint32_t keyShared = entry[0], keyBytes = entry[1], restShared = entry[2], restBytes = entry[3];
+    if (keyShared > key.size() || restShared > rest.size() ||
+        pos + ENTRY_HEADER_SIZE + keyBytes + restBytes > end) {
+        return false;
+    }
+    const char* data = buffer + pos + ENTRY_HEADER_SIZE;
+    key.resize(keyShared);
+    key.append(data, keyBytes);
+    rest.resize(restShared);
+    rest.append(data + keyBytes, restBytes);
+    pos += ENTRY_HEADER_SIZE + keyBytes + restBytes;
+    return true;
+}
+
+// Decodes every record of a front-coded block into 'expanded' (once per change)
+void BSSBlock::expand() const {
+    if (expandedValid) return;
+    expanded.clear();
+    expandedRecords.clear();
+
+    const BlockHeader* header = getHeader();
+    uint32_t count = recordLimit();
+    uint32_t end = std::min<uint32_t>(header->dataStart, blockSize - header->restartCount * sizeof(uint16_t));
+    uint32_t pos = sizeof(BlockHeader);
+    uint32_t nextRestart = 0;
+    std::string key, rest;
+    for (uint32_t i = 0; i < count; ++i) {
+        bool restart = nextRestart < header->restartCount && restartOffset(nextRestart) == pos;
+        if (restart) nextRestart++;
+        if (!decodeEntry(pos, end, key, rest)) break;  // Damaged block: keep the intact records
+        expandedRecords.push_back({(uint32_t)expanded.size(), (uint32_t)(key.size() + rest.size()), restart});
+        expanded += key;
+        expanded += rest;
+    }
+    expandedValid = true;
+}
+
+void BSSBlock::readSlot(uint32_t i, uint16_t& offset, uint16_t& length) const {
+    const char* slot = slotAt(i);
+    memcpy(&offset, slot, sizeof(offset));
+    memcpy(&length, slot + sizeof(uint16_t), sizeof(length));
+}
+
+/**
+ * @brief Removes the first record with a zip code, keeping the block links.
+ * @param zipCode The key to remove.
+ * @return False if the block holds no such record.
+ */
+bool BSSBlock::removeRecord(std::string_view zipCode) {
+    if (getHeader()->blockType != 'A') return false;
+    ensureOwned();
+    if (isFrontCoded()) {
+        return removeRecordFrontCoded(ZipKey(zipCode));
+    }
+
+    std::vector<ZipCodeRecordBuffer> records = unpackAllRecords();
+    auto match = std::find_if(records.begin(), records.end(), [zipCode](const ZipCodeRecordBuffer& rec) {
+        return rec.getZipCode() == zipCode;
+    });
+    if (match == records.end()) return false;
+    records.erase(match);
+
+    // clear() resets the links, so carry them over
+    BlockHeader links = *getHeader();
+    clear();
+    getHeader()->predecessorRBN = links.predecessorRBN;
+    getHeader()->successorRBN = links.successorRBN;
+    for (const auto& rec : records) {
+        if (!addRecord(rec)) return false;
     }
     return true;
 }
 
+/**
+ * @brief Looks up a record by zip code within this block.
+ * @param zipCode The key to find.
+ * @param out Receives the unpacked record when found.
+ * @return True if the block holds a record with that key.
+ */
+bool BSSBlock::findRecord(const std::string& zipCode, ZipCodeRecordBuffer& out) const {
+    RecordView view;
+    if (!findRecord(std::string_view(zipCode), view)) return false;
+    out = view.toRecord();
+    return true;
+}
+
+/**
+ * @brief Zero-copy variant of findRecord.
+ * @param zipCode The key to find.
+ * @param out Receives a view into this block's buffer when found.
+ * @return True if the block holds a record with that key.
+ */
+bool BSSBlock::findRecord(std::string_view zipCode, RecordView& out) const {
+    if (getHeader()->blockType != 'A') return false;
+
+    if (isSlotted()) {
+        ZipKey key(zipCode);
+        uint32_t lo = 0;
+        uint32_t hi = getHeader()->recordCount;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            ZipKey stored = slotKey(mid);
+            if (stored == key) {
+                uint16_t offset, length;
+                readSlot(mid, offset, length);
+                out = RecordView(std::string_view(buffer + offset, length), recordEncoding, dictionary);
+                return true;
+            }
+            if (stored < key) lo = mid + 1;
+            else hi = mid;
+        }
+        return false;
+    }
+
+    if (isFrontCoded()) {
+        // Last restart point at or below the key; its group is the only one that can hold it
+        ZipKey key(zipCode);
+        uint32_t restarts = getHeader()->restartCount;
+        uint32_t lo = 0;
+        uint32_t hi = restarts;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            uint32_t pos = restartOffset(mid);
+            if (pos + ENTRY_HEADER_SIZE > getHeader()->dataStart) return false;
+            uint32_t keyBytes = static_cast<unsigned char>(buffer[pos + 1]);
+            if (pos + ENTRY_HEADER_SIZE + keyBytes > getHeader()->dataStart) return false;
+            std::string_view keyPart(buffer + pos + ENTRY_HEADER_SIZE, keyBytes);
+            if (keyPartKey(keyPart) <= key) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == 0) return false;
+
+        uint32_t pos = restartOffset(lo - 1);
+        uint32_t groupEnd = (lo < restarts) ? restartOffset(lo) : getHeader()->dataStart;
+        std::string keyPart, rest;
+        while (pos < groupEnd) {
+            if (!decodeEntry(pos, groupEnd, keyPart, rest)) return false;
+            ZipKey stored = keyPartKey(keyPart);
+            if (stored == key) {
+                lookupRecord = keyPart + rest;
+                out = RecordView(lookupRecord, recordEncoding, dictionary);
+                return true;
+            }
+            if (stored > key) return false;
+        }
+        return false;
+    }
+
+    for (const RecordView& rec : *this) {
+        if (rec.isValid() && rec.getZipCode() == zipCode) {
+            out = rec;
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * @brief Reads a block from the file at a specific RBN.
  * @param file The file stream.
@@ -85,68 +572,111 @@ bool BSSBlock::addRecord(const ZipCodeRecordBuffer& record) {
  * @return True on success.
  */
 bool BSSBlock::read(std::fstream& file, int rbn, uint32_t bSize) {
-    std::cout << "[BSSBlock::read] Reading RBN " << rbn << ", blockSize=" << bSize << std::endl;
-    std::cout.flush();
-    
-    if (blockSize != bSize) {
-        delete[] buffer;
+    LOG_TRACE("BSSBlock::read", "Reading RBN " << rbn << ", blockSize=" << bSize);
+
+    if (blockSize != bSize || !ownsBuffer) {
+        if (ownsBuffer) delete[] buffer;
         blockSize = bSize;
         buffer = new char[blockSize];
+        ownsBuffer = true;
     }
-    
-    std::cout << "[BSSBlock::read] Seeking to position " << ((long long)rbn * blockSize) << std::endl;
-    std::cout.flush();
-    
+
+    LOG_TRACE("BSSBlock::read", "Seeking to position " << ((long long)rbn * blockSize));
+
     file.seekg((long long)rbn * blockSize, std::ios::beg);
-    
-    std::cout << "[BSSBlock::read] Reading " << blockSize << " bytes..." << std::endl;
-    std::cout.flush();
-    
+
+    LOG_TRACE("BSSBlock::read", "Reading " << blockSize << " bytes...");
+
     file.read(buffer, blockSize);
-    
-    std::cout << "[BSSBlock::read] Read complete. Parsing block..." << std::endl;
-    std::cout.flush();
-    
-    // After reading, parse the block to set internal state
-    currentSize = sizeof(BlockHeader); // Start after header
-    highestKey = "";
+
+    LOG_TRACE("BSSBlock::read", "Read complete. Parsing block...");
+
+    bool ok = file.good();
+    parse();
+    return ok;
+}
+
+/**
+ * @brief Loads a block image that is already in memory (e.g. a cache frame).
+ * @param src Pointer to bSize bytes holding the raw block.
+ * @param bSize The block size (from file header).
+ * @param version The file's block format version.
+ * @param encoding The file's record encoding.
+ * @param fieldDictionary The file's dictionary (BinaryDictionary files only).
+ * @return True on success.
+ */
+bool BSSBlock::load(const char* src, uint32_t bSize, uint32_t version, RecordEncoding encoding,
+                    FieldDictionary* fieldDictionary) {
+    if (!src) return false;
+    if (blockSize != bSize || !ownsBuffer) {
+        if (ownsBuffer) delete[] buffer;
+        blockSize = bSize;
+        buffer = new char[blockSize];
+        ownsBuffer = true;
+    }
+    formatVersion = version;
+    recordEncoding = encoding;
+    dictionary = fieldDictionary;
+    memcpy(buffer, src, blockSize);
+    parse();
+    return true;
+}
+
+/**
+ * @brief Points the block at an existing block image without copying it.
+ * @param src Pointer to bSize bytes (e.g. inside a read-only file mapping).
+ * @param bSize The block size (from file header).
+ * @param version The file's block format version.
+ * @param encoding The file's record encoding.
+ * @param fieldDictionary The file's dictionary (BinaryDictionary files only).
+ * @return True on success.
+ */
+bool BSSBlock::attach(const char* src, uint32_t bSize, uint32_t version, RecordEncoding encoding,
+                      FieldDictionary* fieldDictionary) {
+    if (!src) return false;
+    if (ownsBuffer) delete[] buffer;
+    // Never written through while attached: every mutator calls ensureOwned() first
+    buffer = const_cast<char*>(src);
+    ownsBuffer = false;
+    blockSize = bSize;
+    formatVersion = version;
+    recordEncoding = encoding;
+    dictionary = fieldDictionary;
+    parse();
+    return true;
+}
+
+// Rebuilds currentSize and highestKey from the raw buffer
+void BSSBlock::parse() {
     BlockHeader* header = getHeader();
-    
-    std::cout << "[BSSBlock::read] Block header: recordCount=" << header->recordCount
-              << ", type=" << header->blockType << std::endl;
-    std::cout.flush();
-
-    for (uint32_t i = 0; i < header->recordCount; ++i) {
-        if (currentSize + sizeof(uint16_t) > blockSize) break; // Corrupt block
-        
-        // Read length
-        uint16_t recordLen;
-        memcpy(&recordLen, buffer + currentSize, sizeof(uint16_t));
-        currentSize += sizeof(uint16_t);
-
-        if (currentSize + recordLen > blockSize) break; // Corrupt block
-
-        // Get record string
-        std::string recStr(buffer + currentSize, recordLen);
-        currentSize += recordLen;
-
-        // Unpack just to find the key
-        ZipCodeRecordBuffer tempRec;
-        if (tempRec.unpack(recStr)) {
-            if (tempRec.getZipCode() > highestKey) {
-                highestKey = tempRec.getZipCode();
-            }
+
+    LOG_TRACE("BSSBlock::parse", "Block header: recordCount=" << header->recordCount
+              << ", type=" << header->blockType);
+
+    expandedValid = false;
+
+    // Slotted and front-coded blocks carry their highest key, so there is nothing to scan
+    if (hasKeyedHeader()) {
+        highestKey = ZipKey();
+        if (header->blockType == 'A' && header->recordCount > 0) {
+            highestKey = ZipKey::fromField(header->highestKey, ZIP_CODE_LENGTH);
         }
+        return;
     }
-    // Reset currentSize to its 'packed' state
-    currentSize = sizeof(BlockHeader);
-    for(uint32_t i=0; i<getHeader()->recordCount; ++i) {
-        uint16_t recordLen;
-        memcpy(&recordLen, buffer + currentSize, sizeof(uint16_t));
-        currentSize += sizeof(uint16_t) + recordLen;
+
+    // After reading, walk the records to set internal state
+    highestKey = ZipKey();
+    for (const RecordView& rec : *this) {
+        if (!rec.isValid()) continue;
+        ZipKey key(rec.getZipCode());
+        if (key > highestKey) highestKey = key;
     }
 
-    return file.good();
+    // The iterator stops at the last intact record; that is the 'packed' size
+    currentSize = headerSize();
+    for (const RecordView& rec : *this) {
+        currentSize += sizeof(uint16_t) + rec.getPayload().size();
+    }
 }
 
 // Writes the block's buffer to the file at a specific RBN
@@ -156,24 +686,82 @@ bool BSSBlock::write(std::fstream& file, int rbn) const {
     return file.good();
 }
 
+uint32_t BSSBlock::getUsedBytes() const {
+    const BlockHeader* header = getHeader();
+    if (header->blockType != 'A') return 0;
+    if (isSlotted()) {
+        return header->recordCount * SLOT_SIZE + (blockSize - header->dataStart);
+    }
+    if (isFrontCoded()) {
+        return (header->dataStart - sizeof(BlockHeader)) + header->restartCount * sizeof(uint16_t);
+    }
+    return currentSize - headerSize();
+}
+
 // Gets all records from this block, unpacked.
 std::vector<ZipCodeRecordBuffer> BSSBlock::unpackAllRecords() const {
     std::vector<ZipCodeRecordBuffer> records;
-    BlockHeader* header = getHeader();
-    char* readPos = buffer + sizeof(BlockHeader);
-    
-    for (uint32_t i = 0; i < header->recordCount; ++i) {
-        uint16_t recordLen;
-        memcpy(&recordLen, readPos, sizeof(uint16_t));
-        readPos += sizeof(uint16_t);
-
-        std::string recStr(readPos, recordLen);
-        readPos += recordLen;
-
+    records.reserve(recordLimit());
+    for (const RecordView& view : *this) {
         ZipCodeRecordBuffer rec;
-        if (rec.unpack(recStr)) {
+        if (view.copyTo(rec)) {
             records.push_back(rec);
         }
     }
     return records;
-}
\ No newline at end of file
+}
+
+// --- RecordIterator ---
+
+BSSBlock::RecordIterator::RecordIterator(const BSSBlock* b, uint32_t i)
+    : block(b), index(i), count(b->recordLimit()), position(b->headerSize()) {
+    if (index < count) locate();
+}
+
+BSSBlock::RecordIterator& BSSBlock::RecordIterator::operator++() {
+    ++index;
+    if (index < count) locate();
+    return *this;
+}
+
+// Points current at record 'index', or moves to the end if the block is corrupt
+void BSSBlock::RecordIterator::locate() {
+    const char* buf = block->buffer;
+
+    if (block->isSlotted()) {
+        uint16_t offset, length;
+        block->readSlot(index, offset, length);
+        if ((uint32_t)offset + length > block->blockSize) {
+            index = count;
+            return;
+        }
+        current = RecordView(std::string_view(buf + offset, length), block->recordEncoding, block->dictionary);
+        return;
+    }
+
+    if (block->isFrontCoded()) {
+        block->expand();
+        if (index >= block->expandedRecords.size()) {
+            index = count; // Corrupt block
+            return;
+        }
+        const DecodedRecord& decoded = block->expandedRecords[index];
+        current = RecordView(std::string_view(block->expanded.data() + decoded.offset, decoded.length),
+                             block->recordEncoding, block->dictionary);
+        return;
+    }
+
+    if (position + sizeof(uint16_t) > block->blockSize) {
+        index = count; // Corrupt block
+        return;
+    }
+    uint16_t recordLen;
+    memcpy(&recordLen, buf + position, sizeof(uint16_t));
+    if (position + sizeof(uint16_t) + recordLen > block->blockSize) {
+        index = count; // Corrupt block
+        return;
+    }
+    current = RecordView(std::string_view(buf + position + sizeof(uint16_t), recordLen),
+                         block->recordEncoding, block->dictionary);
+    position += sizeof(uint16_t) + recordLen;
+}
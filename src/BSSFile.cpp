@@ -1,91 +1,470 @@
 #include "../headers/BSSFile.h"
 #include "../headers/HeaderBuffer.h"
+#include "../headers/ExternalSorter.h"
+#include "../headers/Log.h"
+#include "../headers/WriteAheadLog.h"
 #include <fstream>
 #include <vector>
 #include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+BSSFile::BSSFile()
+    : mapping(nullptr), mappedSize(0), readOnly(false), blockSize(512), indexReady(false),
+      indexDirty(false), inOperation(false), headerDirty(false), lastCloseClean(true),
+      groupCommitSize(DEFAULT_GROUP_COMMIT) {
+    // Write-ahead rule: a changed block may reach the file only after its log record
+    cache.setWriteBackGuard([this](int rbn) {
+        return !wal.isOpen() || unsyncedBlocks.count(rbn) == 0 || syncLog();
+    });
+}
 
-BSSFile::BSSFile() : blockSize(512) {
+BSSFile::~BSSFile() {
+    close();
 }
 
-bool BSSFile::create(const std::string& bssFilename, const std::string& proj2DatFile) {
-    file.open(bssFilename, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
-    if (!file) {
-        std::cerr << "Error: Could not create/open file: " << bssFilename << std::endl;
+namespace {
+
+// Orders records by key; equal keys keep their input order so every thread count packs the same file
+bool zipLess(const ZipCodeRecordBuffer& a, const ZipCodeRecordBuffer& b) {
+    return a.getZipKey() < b.getZipKey();
+}
+
+unsigned resolveThreadCount(unsigned requested) {
+    if (requested != 0) return requested;
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw ? hw : 1;
+}
+
+// One worker's share of the .dat records, parsed and sorted
+struct ParsedRun {
+    std::vector<ZipCodeRecordBuffer> records;
+    std::vector<std::pair<uint32_t, std::string>> skipped; // First few rejected records (index, bytes)
+    uint32_t skippedCount = 0;
+};
+
+/**
+ * @brief Writes finished block images to the file, optionally on a background thread.
+ * @note Blocks arrive in RBN order; the queue is bounded so packing can run
+ *       at most a few dozen blocks ahead of the disk.
+ */
+class BlockWriter {
+public:
+    BlockWriter(std::fstream& f, uint32_t bSize, bool background)
+        : file(f), blockSize(bSize), done(false), failed(false) {
+        if (background) worker = std::thread(&BlockWriter::run, this);
+    }
+
+    ~BlockWriter() { finish(); }
+
+    void write(int rbn, const char* image) {
+        if (!worker.joinable()) {
+            writeNow(rbn, image);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        spaceFree.wait(lock, [this] { return pending.size() < MAX_PENDING; });
+        pending.emplace_back(rbn, std::vector<char>(image, image + blockSize));
+        workReady.notify_one();
+    }
+
+    // Waits for every queued block to reach the file; false if any write failed
+    bool finish() {
+        if (worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done = true;
+            }
+            workReady.notify_one();
+            worker.join();
+        }
+        return !failed;
+    }
+
+private:
+    static const size_t MAX_PENDING = 64;
+
+    void run() {
+        for (;;) {
+            std::pair<int, std::vector<char>> item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                workReady.wait(lock, [this] { return done || !pending.empty(); });
+                if (pending.empty()) return;
+                item = std::move(pending.front());
+                pending.pop_front();
+            }
+            spaceFree.notify_one();
+            writeNow(item.first, item.second.data());
+        }
+    }
+
+    void writeNow(int rbn, const char* image) {
+        file.seekp((long long)rbn * blockSize, std::ios::beg);
+        file.write(image, blockSize);
+        if (!file.good()) failed = true;
+    }
+
+    std::fstream& file;
+    uint32_t blockSize;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable workReady;
+    std::condition_variable spaceFree;
+    std::deque<std::pair<int, std::vector<char>>> pending;
+    bool done;
+    bool failed;
+};
+
+} // namespace
+
+bool BSSFile::checkCreateOptions(const BSSCreateOptions& options) {
+    if (options.blockSize < BSSBlock::MIN_BLOCK_SIZE || options.blockSize > BSSBlock::MAX_BLOCK_SIZE) {
+        LOG_ERROR("", "Error: Block size must be between " << BSSBlock::MIN_BLOCK_SIZE << " and "
+                  << BSSBlock::MAX_BLOCK_SIZE << " bytes (got " << options.blockSize << ")");
+        return false;
+    }
+    if (!(options.fillFactor > 0.0 && options.fillFactor <= 1.0)) {
+        LOG_ERROR("", "Error: Fill factor must be in (0, 1] (got " << options.fillFactor << ")");
+        return false;
+    }
+    if (options.formatVersion < BSS_VERSION_LENGTH_PREFIXED || options.formatVersion > BSS_VERSION_FRONT_CODED) {
+        LOG_ERROR("", "Error: Unknown block format version " << options.formatVersion);
         return false;
     }
+    // Version 1 clips the header to one block, which would drop the schema and dictionary fields
+    if (options.formatVersion == BSS_VERSION_LENGTH_PREFIXED &&
+        (options.recordEncoding != RecordEncoding::Text || options.blockSize < sizeof(BSSFileHeader))) {
+        LOG_ERROR("", "Error: Format version 1 needs text records and blocks of at least "
+                  << sizeof(BSSFileHeader) << " bytes");
+        return false;
+    }
+    blockSize = options.blockSize;
+    return true;
+}
+
+bool BSSFile::create(const std::string& bssFilename, const std::string& proj2DatFile,
+                     const BSSCreateOptions& options) {
+    if (!checkCreateOptions(options)) return false;
 
     std::ifstream datFile(proj2DatFile, std::ios::binary);
     if (!datFile) {
-        std::cerr << "Error: Could not open Project 2.0 DAT file: " << proj2DatFile << std::endl;
+        LOG_ERROR("", "Error: Could not open Project 2.0 DAT file: " << proj2DatFile);
         return false;
     }
 
-    header = BSSFileHeader(blockSize);
-    header.setBlockCount(1);
-    header.setListHeadRBN(-1);
-    header.setAvailHeadRBN(-1);
-    header.write(file);
-
-    std::vector<ZipCodeRecordBuffer> records;
     HeaderRecordBuffer p2Header;
     if (!p2Header.readHeader(datFile)) {
-        std::cerr << "Error reading header from " << proj2DatFile << std::endl;
+        LOG_ERROR("", "Error reading header from " << proj2DatFile);
         datFile.close();
         return false;
     }
     
     uint32_t p2RecordCount = p2Header.getRecordCount();
-    ZipCodeRecordBuffer tempRec;
-    uint32_t successfulRecords = 0;
-    uint32_t skippedRecords = 0;
 
+    if (options.memoryBudget > 0) {
+        uint32_t i = 0;
+        std::string recordString;
+        bool ok = createExternal(bssFilename, [&](std::string_view& record) {
+            if (i == p2RecordCount) return false;
+            uint32_t recordLength;
+            if (!datFile.read(reinterpret_cast<char*>(&recordLength), sizeof(recordLength))) {
+                LOG_ERROR("", "Error reading record length at record " << i);
+                return false;
+            }
+            recordString.assign(recordLength, '\0');
+            if (!datFile.read(&recordString[0], recordLength)) {
+                LOG_ERROR("", "Error reading record data at record " << i);
+                return false;
+            }
+            record = recordString;
+            i++;
+            return true;
+        }, options);
+        datFile.close();
+        return ok;
+    }
+
+    // Pull the record section into memory in one read
+    std::streampos dataStart = datFile.tellg();
+    datFile.seekg(0, std::ios::end);
+    size_t dataSize = (size_t)(datFile.tellg() - dataStart);
+    datFile.seekg(dataStart);
+    std::vector<char> data(dataSize);
+    if (dataSize > 0 && !datFile.read(data.data(), dataSize)) {
+        LOG_ERROR("", "Error reading records from " << proj2DatFile);
+        return false;
+    }
+    datFile.close();
+
+    // Locate every record (the length prefixes chain the records together)
+    std::vector<std::pair<size_t, uint32_t>> extents; // (offset of payload, length)
+    extents.reserve(p2RecordCount);
+    size_t pos = 0;
     for (uint32_t i = 0; i < p2RecordCount; ++i) {
         uint32_t recordLength;
-        if (!datFile.read(reinterpret_cast<char*>(&recordLength), sizeof(recordLength))) {
-            std::cerr << "Error reading record length at record " << i << std::endl;
+        if (pos + sizeof(recordLength) > dataSize) {
+            LOG_ERROR("", "Error reading record length at record " << i);
             break;
         }
-
-        std::string recordString(recordLength, '\0');
-        if (!datFile.read(&recordString[0], recordLength)) {
-            std::cerr << "Error reading record data at record " << i << std::endl;
+        memcpy(&recordLength, data.data() + pos, sizeof(recordLength));
+        pos += sizeof(recordLength);
+        if (recordLength > dataSize - pos) {
+            LOG_ERROR("", "Error reading record data at record " << i);
             break;
         }
+        extents.emplace_back(pos, recordLength);
+        pos += recordLength;
+    }
+
+    return createInMemory(bssFilename, data, extents, options);
+}
+
+bool BSSFile::createFromCsv(const std::string& bssFilename, const std::string& csvFile,
+                            const BSSCreateOptions& options) {
+    if (!checkCreateOptions(options)) return false;
+
+    std::ifstream in(csvFile, std::ios::binary);
+    if (!in) {
+        LOG_ERROR("", "Error: Could not open CSV file: " << csvFile);
+        return false;
+    }
 
+    // Records are the CSV lines after the header row; empty lines are skipped, as processFile does
+    if (options.memoryBudget > 0) {
+        std::string line;
+        bool headerSkipped = false;
+        bool ok = createExternal(bssFilename, [&](std::string_view& record) {
+            while (std::getline(in, line)) {
+                if (!headerSkipped) {
+                    headerSkipped = true;
+                    continue;
+                }
+                if (line.empty()) continue;
+                record = line;
+                return true;
+            }
+            return false;
+        }, options);
+        in.close();
+        return ok;
+    }
+
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    std::vector<std::pair<size_t, uint32_t>> extents; // (offset of line, length)
+    const char* text = data.data();
+    size_t pos = 0;
+    bool headerSkipped = false;
+    while (pos < data.size()) {
+        const char* lineEnd = static_cast<const char*>(memchr(text + pos, '\n', data.size() - pos));
+        size_t end = lineEnd ? (size_t)(lineEnd - text) : data.size();
+        if (headerSkipped && end > pos) extents.emplace_back(pos, (uint32_t)(end - pos));
+        headerSkipped = true;
+        pos = end + 1;
+    }
+
+    return createInMemory(bssFilename, data, extents, options);
+}
+
+bool BSSFile::createInMemory(const std::string& bssFilename, std::vector<char>& data,
+                             const std::vector<std::pair<size_t, uint32_t>>& extents,
+                             const BSSCreateOptions& options) {
+    // Parse and sort contiguous chunks in parallel; each chunk becomes a sorted run
+    unsigned threadCount = resolveThreadCount(options.threads);
+    size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, extents.size()));
+    std::vector<ParsedRun> runs(chunkCount);
+
+    auto parseChunk = [&](size_t chunk) {
+        size_t lo = extents.size() * chunk / chunkCount;
+        size_t hi = extents.size() * (chunk + 1) / chunkCount;
+        ParsedRun& run = runs[chunk];
+        run.records.reserve(hi - lo);
+        ZipCodeRecordBuffer tempRec;
+        for (size_t i = lo; i < hi; ++i) {
+            std::string_view recordString(data.data() + extents[i].first, extents[i].second);
+            if (tempRec.unpack(recordString)) {
+                run.records.push_back(tempRec);
+            } else {
+                if (run.skippedCount < 3) run.skipped.emplace_back((uint32_t)i, std::string(recordString));
+                run.skippedCount++;
+            }
+        }
+        std::stable_sort(run.records.begin(), run.records.end(), zipLess);
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t chunk = 1; chunk < chunkCount; ++chunk) {
+        workers.emplace_back(parseChunk, chunk);
+    }
+    parseChunk(0);
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+
+    uint32_t successfulRecords = 0;
+    uint32_t skippedRecords = 0;
+    uint32_t reported = 0;
+    for (const auto& run : runs) {
+        // Report the first three rejects in file order, like a single pass would
+        for (const auto& skip : run.skipped) {
+            if (reported == 3) break;
+            LOG_WARN("", "Skipping invalid record " << skip.first << " (likely header fragment)");
+            if (skip.second.length() < 100) {
+                LOG_WARN("", "  Content: '" << skip.second << "'");
+            }
+            reported++;
+        }
+        successfulRecords += (uint32_t)run.records.size();
+        skippedRecords += run.skippedCount;
+    }
+    data.clear();
+    data.shrink_to_fit();
+
+    LOG_INFO("", "Loaded " << successfulRecords << " valid records (skipped "
+              << skippedRecords << " invalid records)");
+
+    // Merge neighbouring runs pairwise until one is left. std::merge prefers the
+    // left run on ties, so the result is the same as one stable sort of the input.
+    while (runs.size() > 1) {
+        std::vector<ParsedRun> merged((runs.size() + 1) / 2);
+        auto mergePair = [&](size_t k) {
+            if (2 * k + 1 == runs.size()) {
+                merged[k].records = std::move(runs[2 * k].records);
+                return;
+            }
+            std::vector<ZipCodeRecordBuffer>& left = runs[2 * k].records;
+            std::vector<ZipCodeRecordBuffer>& right = runs[2 * k + 1].records;
+            merged[k].records.reserve(left.size() + right.size());
+            std::merge(std::make_move_iterator(left.begin()), std::make_move_iterator(left.end()),
+                       std::make_move_iterator(right.begin()), std::make_move_iterator(right.end()),
+                       std::back_inserter(merged[k].records), zipLess);
+            std::vector<ZipCodeRecordBuffer>().swap(left);
+            std::vector<ZipCodeRecordBuffer>().swap(right);
+        };
+        for (size_t k = 1; k < merged.size(); ++k) {
+            workers.emplace_back(mergePair, k);
+        }
+        mergePair(0);
+        for (auto& worker : workers) worker.join();
+        workers.clear();
+        runs = std::move(merged);
+    }
+
+    std::vector<ZipCodeRecordBuffer> records = std::move(runs[0].records);
+    return writeSequenceSet(bssFilename, records, threadCount > 1, options.fillFactor,
+                            options.recordEncoding, options.formatVersion);
+}
+
+bool BSSFile::createExternal(const std::string& bssFilename,
+                             const std::function<bool(std::string_view&)>& nextRecordText,
+                             const BSSCreateOptions& options) {
+    size_t memoryBudget = options.memoryBudget;
+    ExternalSorter sorter(memoryBudget, bssFilename);
+    ZipCodeRecordBuffer tempRec;
+    uint32_t successfulRecords = 0;
+    uint32_t skippedRecords = 0;
+    std::string_view recordString;
+
+    for (uint32_t i = 0; nextRecordText(recordString); ++i) {
         if (tempRec.unpack(recordString)) {
-            records.push_back(tempRec);
+            if (!sorter.add(tempRec)) return false;
             successfulRecords++;
         } else {
             skippedRecords++;
             if (skippedRecords <= 3) {
-                std::cerr << "Skipping invalid record " << i << " (likely header fragment)\n";
+                LOG_WARN("", "Skipping invalid record " << i << " (likely header fragment)");
                 if (recordString.length() < 100) {
-                    std::cerr << "  Content: '" << recordString << "'\n";
+                    LOG_WARN("", "  Content: '" << recordString << "'");
                 }
             }
         }
     }
-    
-    std::cout << "Loaded " << successfulRecords << " valid records (skipped "
-              << skippedRecords << " invalid records)\n";
-    datFile.close();
 
-    std::sort(records.begin(), records.end(), [](const auto& a, const auto& b) {
-        return a.getZipCode() < b.getZipCode();
-    });
+    LOG_INFO("", "Loaded " << successfulRecords << " valid records (skipped "
+              << skippedRecords << " invalid records)");
+
+    if (!sorter.finish()) return false;
+    LOG_INFO("", "External sort: " << sorter.getRunCount() << " run(s) spilled, peak ~"
+              << sorter.getPeakBytes() / 1024 << " KiB of " << memoryBudget / 1024 << " KiB budget");
+
+    // The merge feeds block packing directly; the sorted records never sit in memory together
+    return packSequenceSet(bssFilename, [&sorter](ZipCodeRecordBuffer& out) {
+        return sorter.next(out);
+    }, false, options.fillFactor, options.recordEncoding, options.formatVersion);
+}
+
+bool BSSFile::writeSequenceSet(const std::string& bssFilename, std::vector<ZipCodeRecordBuffer>& records,
+                               bool backgroundWrites, double fillFactor, RecordEncoding encoding,
+                               uint32_t formatVersion) {
+    if (!std::is_sorted(records.begin(), records.end(), zipLess)) {
+        std::stable_sort(records.begin(), records.end(), zipLess);
+    }
+
+    size_t next = 0;
+    return packSequenceSet(bssFilename, [&records, &next](ZipCodeRecordBuffer& out) {
+        if (next == records.size()) return false;
+        out = std::move(records[next++]);
+        return true;
+    }, backgroundWrites, fillFactor, encoding, formatVersion);
+}
+
+bool BSSFile::packSequenceSet(const std::string& bssFilename,
+                              const std::function<bool(ZipCodeRecordBuffer&)>& nextRecord,
+                              bool backgroundWrites, double fillFactor, RecordEncoding encoding,
+                              uint32_t formatVersion) {
+    // A log left by an earlier file of the same name must never be replayed into this one
+    std::remove((bssFilename + ".wal").c_str());
+    file.open(bssFilename, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file) {
+        LOG_ERROR("", "Error: Could not create/open file: " << bssFilename);
+        return false;
+    }
+    cache.attach(&file, blockSize);
+    index.clear();
+    indexReady = false;
+    indexPath.clear();
+    indexDirty = false;
+
+    header = BSSFileHeader(blockSize, formatVersion);
+    header.setRecordEncoding(encoding);
+    dictionary.clear();
+    dictionaryRBNs.clear();
+    header.setBlockCount(header.getHeaderBlockCount());
+    header.setListHeadRBN(-1);
+    header.setAvailHeadRBN(-1);
+    header.write(file);
 
-    header.setRecordCount((uint32_t)records.size());
-    int currentRBN = 1;
+    uint32_t recordCount = 0;
+    int currentRBN = (int)header.getHeaderBlockCount();
     int prevRBN = -1;
     
-    BSSBlock block(blockSize);
+    BSSBlock block(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+    BlockWriter writer(file, blockSize, backgroundWrites);
+    ZipCodeRecordBuffer rec;
+    uint32_t fillLimit = (uint32_t)(fillFactor * block.getCapacityBytes());
     
-    for (const auto& rec : records) {
-        if (!block.addRecord(rec)) {
+    while (nextRecord(rec)) {
+        recordCount++;
+        if (!block.addRecord(rec, fillLimit)) {
             block.getHeader()->predecessorRBN = prevRBN;
             block.getHeader()->successorRBN = currentRBN + 1;
-            block.write(file, currentRBN);
+            writer.write(currentRBN, block.getBuffer());
+            index.setEntry(block.getHighestZipKey(), currentRBN);
 
             if (prevRBN == -1) {
                 header.setListHeadRBN(currentRBN);
@@ -94,73 +473,394 @@ bool BSSFile::create(const std::string& bssFilename, const std::string& proj2Dat
             prevRBN = currentRBN;
             currentRBN++;
             block.clear();
-            block.addRecord(rec);
+            if (!block.addRecord(rec)) {
+                LOG_ERROR("", "Error: Record " << rec.getZipCode() << " does not fit in a "
+                          << blockSize << "-byte block");
+                writer.finish();
+                close();
+                return false;
+            }
         }
     }
+    header.setRecordCount(recordCount);
 
     if (block.getHeader()->recordCount > 0) {
         block.getHeader()->predecessorRBN = prevRBN;
         block.getHeader()->successorRBN = -1;
-        block.write(file, currentRBN);
+        writer.write(currentRBN, block.getBuffer());
+        index.setEntry(block.getHighestZipKey(), currentRBN);
         if (prevRBN == -1) {
              header.setListHeadRBN(currentRBN);
         }
-    } else {
-        if (prevRBN != -1) {
-            BSSBlock prevBlock(blockSize);
-            readBlock(prevRBN, prevBlock);
-            prevBlock.getHeader()->successorRBN = -1;
-            writeBlock(prevRBN, prevBlock);
-        }
+    }
+    if (!writer.finish()) {
+        LOG_ERROR("", "Error: Failed writing blocks to " << bssFilename);
+        file.clear();
+        close();
+        return false;
+    }
+    if (block.getHeader()->recordCount == 0 && prevRBN != -1) {
+        BSSBlock prevBlock(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+        readBlock(prevRBN, prevBlock);
+        prevBlock.getHeader()->successorRBN = -1;
+        writeBlock(prevRBN, prevBlock);
     }
     
     header.setBlockCount(currentRBN + 1);
-    std::cout << "Writing header: blockCount=" << header.getBlockCount()
+    if (encoding == RecordEncoding::BinaryDictionary && !saveDictionary()) {
+        LOG_ERROR("", "Error: Failed writing the dictionary to " << bssFilename);
+        close();
+        return false;
+    }
+    LOG_INFO("", "Writing header: blockCount=" << header.getBlockCount()
               << ", recordCount=" << header.getRecordCount()
-              << ", listHeadRBN=" << header.getListHeadRBN() << "\n";
+              << ", listHeadRBN=" << header.getListHeadRBN());
     header.write(file);
-    file.close();
+
+    // The index was gathered from the blocks as they were written; no rescan of the file
+    indexPath = bssFilename + ".idx";
+    indexReady = true;
+    if (!saveIndex()) {
+        LOG_ERROR("", "Error: Failed writing the index " << indexPath);
+        close();
+        return false;
+    }
+    LOG_INFO("", "Index built with " << index.size() << " entries while packing");
+    close();
+    return true;
+}
+
+bool BSSFile::upgrade(const std::string& oldFilename, const std::string& newFilename) {
+    BSSFile source;
+    if (!source.open(oldFilename)) {
+        LOG_ERROR("", "Error: Could not open " << oldFilename << " for upgrade");
+        return false;
+    }
+
+    // Front-coded files are newer than the default format and stay front-coded
+    uint32_t oldVersion = source.header.getVersion();
+    uint32_t newVersion = std::max(oldVersion, BSS_VERSION_CURRENT);
+    LOG_INFO("UPGRADE", oldFilename << " is format version " << oldVersion
+              << ", rewriting as version " << newVersion);
+
+    // Collect the records in logical order; the avail list is dropped
+    std::vector<ZipCodeRecordBuffer> records;
+    RecordEncoding encoding = source.header.getRecordEncoding();
+    BSSBlock block(source.blockSize, oldVersion, encoding);
+    int rbn = source.header.getListHeadRBN();
+    uint32_t visited = 0;
+    while (rbn != -1 && visited < source.header.getBlockCount()) {
+        if (!source.readBlock(rbn, block)) {
+            LOG_ERROR("", "Error: Could not read block " << rbn << " during upgrade");
+            source.close();
+            return false;
+        }
+        std::vector<ZipCodeRecordBuffer> blockRecords = block.unpackAllRecords();
+        records.insert(records.end(), blockRecords.begin(), blockRecords.end());
+        rbn = block.getHeader()->successorRBN;
+        visited++;
+    }
+    uint32_t oldBlockSize = source.blockSize;
+    source.close();
+
+    // Rewriting in place goes through a temporary file so a failure keeps the original
+    bool inPlace = (oldFilename == newFilename);
+    std::string target = inPlace ? newFilename + ".tmp" : newFilename;
+
+    BSSFile result;
+    result.blockSize = oldBlockSize;
+    if (!result.writeSequenceSet(target, records, false, 1.0, encoding, newVersion)) {
+        return false;
+    }
+
+    if (inPlace) {
+        std::remove(oldFilename.c_str());
+        if (std::rename(target.c_str(), oldFilename.c_str()) != 0) {
+            LOG_ERROR("", "Error: Could not replace " << oldFilename << " with " << target);
+            return false;
+        }
+        // The index follows its file; the generation it carries is unchanged by the rename
+        std::string indexFilename = oldFilename + ".idx";
+        std::remove(indexFilename.c_str());
+        if (std::rename((target + ".idx").c_str(), indexFilename.c_str()) != 0) {
+            LOG_ERROR("", "Error: Could not replace " << indexFilename << " with " << target << ".idx");
+            return false;
+        }
+    }
+
+    LOG_INFO("UPGRADE", "Wrote " << records.size() << " records to " << newFilename);
     return true;
 }
 
-bool BSSFile::open(const std::string& bssFilename) {
-    std::cout << "[BSSFile::open] Opening file: " << bssFilename << "\n";
-    file.open(bssFilename, std::ios::in | std::ios::out | std::ios::binary);
+bool BSSFile::open(const std::string& bssFilename, OpenMode mode) {
+    LOG_DEBUG("BSSFile::open", "Opening file: " << bssFilename);
+
+    // Finish the operations a crash interrupted before anything reads the file
+    std::string walFilename = bssFilename + ".wal";
+    size_t replayed = 0;
+    if (!WriteAheadLog::recover(walFilename, bssFilename, replayed)) {
+        LOG_ERROR("BSSFile::open", "Failed to recover " << bssFilename << " from " << walFilename);
+        return false;
+    }
+
+    readOnly = (mode == OpenMode::MappedReadOnly);
+    std::ios::openmode fileMode = std::ios::in | std::ios::binary;
+    if (!readOnly) fileMode |= std::ios::out;
+    file.open(bssFilename, fileMode);
     if (!file) {
-        std::cerr << "[BSSFile::open] Failed to open file\n";
+        LOG_ERROR("BSSFile::open", "Failed to open file");
         return false;
     }
     
-    std::cout << "[BSSFile::open] Reading header...\n";
+    LOG_DEBUG("BSSFile::open", "Reading header...");
     if (!header.read(file)) {
-        std::cerr << "[BSSFile::open] Failed to read header\n";
+        LOG_ERROR("BSSFile::open", "Failed to read header");
         return false;
     }
     
     blockSize = header.getBlockSize();
-    std::cout << "[BSSFile::open] Header read successfully. blockSize=" << blockSize
-              << ", listHeadRBN=" << header.getListHeadRBN() << "\n";
+    cache.attach(&file, blockSize);
+    index.clear();
+    indexReady = false;
+    indexPath.clear();
+    indexDirty = false;
+    filePath = bssFilename;
+
+    headerDirty = false;
+    lastCloseClean = !header.isOpenForWriting();
+
+    if (!readOnly) {
+        if (!wal.open(walFilename)) {
+            file.close();
+            return false;
+        }
+        if (!lastCloseClean) {
+            LOG_WARN("BSSFile::open", bssFilename << " was not closed cleanly"
+                     << (replayed ? "; its logged operations were recovered" : ""));
+        }
+        // Marked on disk before any change can reach the file, cleared again by close()
+        header.setOpenForWriting(true);
+        if (!header.write(file) || !file.flush() || !WriteAheadLog::syncFile(bssFilename)) {
+            LOG_ERROR("BSSFile::open", "Failed to write header");
+            wal.close(true);
+            file.close();
+            return false;
+        }
+    }
+
+#ifndef _WIN32
+    if (readOnly) {
+        int fd = ::open(bssFilename.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+            LOG_ERROR("BSSFile::open", "Failed to map file");
+            if (fd >= 0) ::close(fd);
+            file.close();
+            return false;
+        }
+        void* addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // The mapping keeps its own reference to the file
+        if (addr == MAP_FAILED) {
+            LOG_ERROR("BSSFile::open", "Failed to map file");
+            file.close();
+            return false;
+        }
+        mapping = static_cast<const char*>(addr);
+        mappedSize = (size_t)st.st_size;
+        adviseAccess(AccessPattern::Random);
+    }
+#else
+    if (readOnly) {
+        LOG_DEBUG("BSSFile::open", "Memory mapping not supported here; reading through fstream");
+    }
+#endif
+
+    if (!loadDictionary()) {
+        LOG_ERROR("BSSFile::open", "Failed to read the dictionary of " << bssFilename);
+        close();
+        return false;
+    }
+
+    LOG_DEBUG("BSSFile::open", "Header read successfully. blockSize=" << blockSize
+              << ", listHeadRBN=" << header.getListHeadRBN());
     return true;
 }
 
 void BSSFile::close() {
-    if (file.is_open()) file.close();
+    if (file.is_open()) {
+        if (indexDirty) saveIndex();
+        if (wal.isOpen()) {
+            // The log is only needed until the file holds everything it describes
+            header.setOpenForWriting(false);
+            headerDirty = true;
+            bool checkpointed = sync();
+            if (!checkpointed) {
+                LOG_ERROR("WAL", "Checkpoint failed; keeping the log for recovery on the next open");
+            }
+            wal.close(checkpointed);
+        } else {
+            cache.flush();
+        }
+        file.close();
+    }
+    indexPath.clear();
+    indexDirty = false;
+    cache.detach();
+    unmap();
+    readOnly = false;
+    dictionary.clear();
+    dictionaryRBNs.clear();
+}
+
+void BSSFile::unmap() {
+#ifndef _WIN32
+    if (mapping) munmap(const_cast<char*>(mapping), mappedSize);
+#endif
+    mapping = nullptr;
+    mappedSize = 0;
+}
+
+void BSSFile::adviseAccess(AccessPattern pattern) {
+#ifndef _WIN32
+    if (!mapping) return;
+    int advice = (pattern == AccessPattern::Sequential) ? MADV_SEQUENTIAL : MADV_RANDOM;
+    madvise(const_cast<char*>(mapping), mappedSize, advice);
+#else
+    (void)pattern;
+#endif
 }
 
 bool BSSFile::readBlock(int rbn, BSSBlock& block) {
     if (!file.is_open()) return false;
-    return block.read(file, rbn, blockSize);
+
+    // An operation sees the blocks it has already changed
+    if (inOperation) {
+        auto staged = pendingBlocks.find(rbn);
+        if (staged != pendingBlocks.end()) {
+            return block.load(staged->second.data(), blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+        }
+    }
+
+    // Mapped: hand out a view of the block, no copy and no cache
+    if (mapping) {
+        if (rbn < 0 || (size_t)(rbn + 1) * blockSize > mappedSize) return false;
+        return block.attach(mapping + (size_t)rbn * blockSize, blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+    }
+
+    // The leading blocks hold the file header, which is written directly and never cached
+    if (rbn < (int)header.getHeaderBlockCount()) return block.read(file, rbn, blockSize);
+
+    const char* frame = cache.pin(rbn);
+    if (!frame) return false;
+    bool ok = block.load(frame, blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+    cache.unpin(rbn, false);
+    return ok;
 }
 
 bool BSSFile::writeBlock(int rbn, const BSSBlock& block) {
+    if (!file.is_open() || readOnly) return false;
+    if (rbn < (int)header.getHeaderBlockCount()) return block.write(file, rbn);
+
+    // Logged: hold the image until the operation commits (a lone write is its own operation)
+    if (wal.isOpen()) {
+        bool alone = !inOperation;
+        if (alone) beginOperation();
+        pendingBlocks[rbn].assign(block.getBuffer(), block.getBuffer() + blockSize);
+        return alone ? commitOperation() : true;
+    }
+
+    // The whole block is overwritten, so a miss needs no disk read
+    char* frame = cache.pin(rbn, false);
+    if (!frame) return false;
+    memcpy(frame, block.getBuffer(), blockSize);
+    cache.unpin(rbn, true);
+    return true;
+}
+
+bool BSSFile::flush() {
     if (!file.is_open()) return false;
-    return block.write(file, rbn);
+    // The header obeys the write-ahead rule too; the cache syncs the log for the blocks it writes
+    if (wal.isOpen() && headerDirty && !syncLog()) return false;
+    if (!cache.flush()) return false;
+    if (headerDirty) {
+        if (!header.write(file)) return false;
+        headerDirty = false;
+    }
+    return true;
+}
+
+void BSSFile::setGroupCommit(size_t operations) {
+    groupCommitSize = operations ? operations : 1;
+    if (wal.isOpen() && wal.getUnsyncedCount() >= groupCommitSize) syncLog();
+}
+
+void BSSFile::setCacheOptions(size_t capacity, BlockCache::Policy policy) {
+    cache.configure(capacity, policy);
+}
+
+const CacheStats& BSSFile::getCacheStats() const {
+    return cache.getStats();
+}
+
+void BSSFile::resetCacheStats() {
+    cache.resetStats();
+}
+
+std::vector<BSSFile::LookupResult> BSSFile::lookupBatch(const std::vector<std::string>& zipCodes,
+                                                        const BSSIndex& index) {
+    std::vector<LookupResult> results(zipCodes.size());
+
+    // Resolve every key to its block, then order the work by RBN
+    std::vector<std::pair<int, size_t>> work;
+    work.reserve(zipCodes.size());
+    for (size_t i = 0; i < zipCodes.size(); ++i) {
+        results[i].zipCode = zipCodes[i];
+        int rbn = index.findRBN(zipCodes[i]);
+        results[i].rbn = rbn;
+        if (rbn != -1) work.emplace_back(rbn, i);
+    }
+    std::sort(work.begin(), work.end());
+
+    BSSBlock block(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+    size_t next = 0;
+    while (next < work.size()) {
+        int rbn = work[next].first;
+        size_t groupEnd = next;
+        while (groupEnd < work.size() && work[groupEnd].first == rbn) ++groupEnd;
+
+        // One read answers every key that maps to this block
+        if (readBlock(rbn, block)) {
+            for (size_t w = next; w < groupEnd; ++w) {
+                LookupResult& result = results[work[w].second];
+                RecordView rec;
+                if (block.findRecord(std::string_view(result.zipCode), rec)) {
+                    result.record = rec.toRecord();
+                    result.found = true;
+                }
+            }
+        } else {
+            LOG_ERROR("", "Error reading block " << rbn << " during batch lookup");
+        }
+        next = groupEnd;
+    }
+    return results;
+}
+
+std::vector<BSSFile::LookupResult> BSSFile::lookupBatch(const std::vector<std::string>& zipCodes) {
+    if (!file.is_open()) return std::vector<LookupResult>();
+    ensureIndex();
+    return lookupBatch(zipCodes, index);
 }
 
 void BSSFile::dumpPhysical(std::ostream& os) {
     os << "\n--- Physical Block Dump ---\n";
-    BSSBlock block(blockSize);
+    adviseAccess(AccessPattern::Sequential);
+    BSSBlock block(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
     for (uint32_t rbn = 0; rbn < header.getBlockCount(); ++rbn) {
+        if (rbn < header.getHeaderBlockCount()) {
+            os << "RBN " << rbn << ": (file header, format version " << header.getVersion() << ")\n";
+            continue;
+        }
         if (!readBlock(rbn, block)) break;
         BSSBlock::BlockHeader* h = block.getHeader();
         os << "RBN " << rbn << ": "
@@ -171,17 +871,19 @@ void BSSFile::dumpPhysical(std::ostream& os) {
            << "HighestKey: " << block.getHighestKey() << "\n";
     }
     os << "---------------------------\n";
+    adviseAccess(AccessPattern::Random);
 }
 
 void BSSFile::dumpLogical(std::ostream& os) {
     os << "\n--- Logical Block Dump ---\n";
-    BSSBlock block(blockSize);
+    BSSBlock block(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
     int rbn = header.getListHeadRBN();
     if (rbn == -1) {
         os << "(No active blocks in sequence set)\n";
         return;
     }
     
+    adviseAccess(AccessPattern::Sequential);
     while (rbn != -1) {
         if (!readBlock(rbn, block)) {
             os << "Error reading RBN " << rbn << "!\n";
@@ -198,189 +900,400 @@ void BSSFile::dumpLogical(std::ostream& os) {
         rbn = h->successorRBN;
     }
     os << "-------------------------\n";
+    adviseAccess(AccessPattern::Random);
 }
 
 bool BSSFile::addRecord(const ZipCodeRecordBuffer& record) {
     if (!file.is_open()) {
-        std::cerr << "Error: File not open for adding record\n";
+        LOG_ERROR("", "Error: File not open for adding record");
         return false;
     }
+    if (readOnly) {
+        LOG_ERROR("", "Error: File is open read-only; cannot add record");
+        return false;
+    }
+
+    beginOperation();
+    return insertRecord(record) ? commitOperation() : abortOperation();
+}
 
+bool BSSFile::insertRecord(const ZipCodeRecordBuffer& record) {
     std::string zipCode = record.getZipCode();
-    int targetRBN = findInsertionBlock(zipCode);
+    int targetRBN = findInsertionBlock(record.getZipKey());
     
     if (targetRBN == -1) {
-        std::cerr << "Error: Could not find insertion block\n";
+        LOG_ERROR("", "Error: Could not find insertion block");
         return false;
     }
 
-    BSSBlock block(blockSize);
+    BSSBlock block(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
     if (!readBlock(targetRBN, block)) {
-        std::cerr << "Error: Could not read block " << targetRBN << "\n";
+        LOG_ERROR("", "Error: Could not read block " << targetRBN);
         return false;
     }
 
+    ZipKey oldHighestKey = block.getHighestZipKey();
     if (block.addRecord(record)) {
         if (!writeBlock(targetRBN, block)) {
-            std::cerr << "Error: Could not write block " << targetRBN << "\n";
+            LOG_ERROR("", "Error: Could not write block " << targetRBN);
             return false;
         }
+        reindexBlock(oldHighestKey, targetRBN, block);
         
         header.setRecordCount(header.getRecordCount() + 1);
-        header.write(file);
+        header.noteModification();
+        indexDirty = true;
+        writeHeader();
         
-        std::cout << "[ADD] Record " << zipCode << " added to block " << targetRBN << " (no split)\n";
+        LOG_INFO("ADD", "Record " << zipCode << " added to block " << targetRBN << " (no split)");
         return true;
     } else {
-        std::cout << "[SPLIT] Block " << targetRBN << " is full, splitting...\n";
+        LOG_INFO("SPLIT", "Block " << targetRBN << " is full, splitting...");
         return splitBlock(targetRBN, record);
     }
 }
 
 bool BSSFile::deleteRecord(const std::string& zipCode) {
     if (!file.is_open()) {
-        std::cerr << "Error: File not open for deleting record\n";
+        LOG_ERROR("", "Error: File not open for deleting record");
+        return false;
+    }
+    if (readOnly) {
+        LOG_ERROR("", "Error: File is open read-only; cannot delete record");
         return false;
     }
 
-    int targetRBN = findInsertionBlock(zipCode);
+    beginOperation();
+    return removeRecord(zipCode) ? commitOperation() : abortOperation();
+}
+
+bool BSSFile::removeRecord(const std::string& zipCode) {
+    int targetRBN = findInsertionBlock(ZipKey(zipCode));
     
     if (targetRBN == -1) {
-        std::cerr << "Error: Could not find block for zip code " << zipCode << "\n";
+        LOG_ERROR("", "Error: Could not find block for zip code " << zipCode);
         return false;
     }
 
-    BSSBlock block(blockSize);
+    BSSBlock block(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
     if (!readBlock(targetRBN, block)) {
-        std::cerr << "Error: Could not read block " << targetRBN << "\n";
+        LOG_ERROR("", "Error: Could not read block " << targetRBN);
         return false;
     }
 
-    std::vector<ZipCodeRecordBuffer> records = block.unpackAllRecords();
-    
-    bool found = false;
-    for (auto it = records.begin(); it != records.end(); ++it) {
-        if (it->getZipCode() == zipCode) {
-            records.erase(it);
-            found = true;
-            break;
-        }
+    // Check for the key on the block buffer before unpacking anything
+    RecordView match;
+    if (!block.findRecord(std::string_view(zipCode), match)) {
+        LOG_INFO("DELETE", "Record " << zipCode << " not found in block " << targetRBN);
+        return false;
     }
 
-    if (!found) {
-        std::cout << "[DELETE] Record " << zipCode << " not found in block " << targetRBN << "\n";
+    // Write the shrunken block first so merge/redistribution see the deletion
+    ZipKey oldHighestKey = block.getHighestZipKey();
+    if (!block.removeRecord(zipCode) || !writeBlock(targetRBN, block)) {
+        LOG_ERROR("", "Error: Could not write block " << targetRBN);
         return false;
     }
+    reindexBlock(oldHighestKey, targetRBN, block);
+    header.setRecordCount(header.getRecordCount() - 1);
+    header.noteModification();
+    indexDirty = true;
+    writeHeader();
 
     uint32_t minRecords = getMinRecordCount();
+    uint32_t remaining = block.getHeader()->recordCount;
     
-    if (records.size() >= minRecords) {
-        block.clear();
-        for (const auto& rec : records) {
-            block.addRecord(rec);
+    if (remaining >= minRecords) {
+        LOG_INFO("DELETE", "Record " << zipCode << " deleted from block " << targetRBN 
+                  << " (no redistribution needed, " << remaining << " records remain)");
+        return true;
+    }
+
+    LOG_INFO("DELETE", "Record " << zipCode << " deleted from block " << targetRBN 
+              << " (" << remaining << " records remain, below minimum of " << minRecords << ")");
+    
+    return rebalanceBlock(targetRBN, block);
+}
+
+bool BSSFile::rebalanceBlock(int rbn, const BSSBlock& block) {
+    // Pair the block with a neighbour, always passing them in sequence order
+    BSSBlock::BlockHeader* h = block.getHeader();
+    int leftRBN = -1;
+    int rightRBN = -1;
+    
+    if (h->successorRBN != -1) {
+        leftRBN = rbn;
+        rightRBN = h->successorRBN;
+    } else if (h->predecessorRBN != -1) {
+        leftRBN = h->predecessorRBN;
+        rightRBN = rbn;
+    }
+    
+    if (leftRBN == -1) {
+        LOG_INFO("DELETE", "Only one block in file, no redistribution possible");
+        return true;
+    }
+    
+    // Check if we should merge or redistribute
+    BSSBlock leftBlock(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+    BSSBlock rightBlock(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+    if (!readBlock(leftRBN, leftBlock) || !readBlock(rightRBN, rightBlock)) {
+        LOG_ERROR("", "Error: Could not read adjacent block");
+        return false;
+    }
+    
+    if (shouldMerge(leftBlock, rightBlock)) {
+        LOG_INFO("MERGE", "Merging blocks " << leftRBN << " and " << rightRBN);
+        if (mergeBlocks(leftRBN, rightRBN)) {
+            return true;
         }
-        
-        if (!writeBlock(targetRBN, block)) {
-            std::cerr << "Error: Could not write block " << targetRBN << "\n";
+        LOG_INFO("MERGE", "Records do not fit in one block, redistributing instead");
+    } else {
+        LOG_INFO("REDISTRIBUTE", "Redistributing blocks " << leftRBN << " and " << rightRBN);
+    }
+
+    if (redistributeBlocks(leftRBN, rightRBN)) {
+        return true;
+    }
+    
+    LOG_ERROR("", "Error: Could not handle underflow");
+    return false;
+}
+
+bool BSSFile::applyChanges(const std::vector<Change>& sortedChanges, ApplyStats* stats) {
+    if (!file.is_open()) {
+        LOG_ERROR("", "Error: File not open for applying changes");
+        return false;
+    }
+    if (readOnly) {
+        LOG_ERROR("", "Error: File is open read-only; cannot apply changes");
+        return false;
+    }
+
+    ApplyStats localStats;
+    ApplyStats& counts = stats ? *stats : localStats;
+    counts = ApplyStats();
+
+    // A stable sort keeps the changes to one key in their given order, so the last still wins
+    auto byKey = [](const Change& a, const Change& b) { return a.key() < b.key(); };
+    const std::vector<Change>* changes = &sortedChanges;
+    std::vector<Change> sorted;
+    if (!std::is_sorted(sortedChanges.begin(), sortedChanges.end(), byKey)) {
+        sorted = sortedChanges;
+        std::stable_sort(sorted.begin(), sorted.end(), byKey);
+        changes = &sorted;
+    }
+
+    size_t next = 0;
+    while (next < changes->size()) {
+        int rbn = findInsertionBlock((*changes)[next].key());
+        if (rbn == -1) {
+            LOG_ERROR("", "Error: Could not find insertion block");
             return false;
         }
-        
-        header.setRecordCount(header.getRecordCount() - 1);
-        header.write(file);
-        
-        std::cout << "[DELETE] Record " << zipCode << " deleted from block " << targetRBN 
-                  << " (no redistribution needed, " << records.size() << " records remain)\n";
+        beginOperation();
+        ApplyStats countsBefore = counts;
+        bool applied = applyBlockChanges(rbn, *changes, next, counts);
+        if (!applied) {
+            // The block may have failed after some index entries changed; rebuild on next use
+            counts = countsBefore;
+            index.clear();
+            indexReady = false;
+        }
+        if (!(applied ? commitOperation() : abortOperation())) {
+            LOG_ERROR("APPLY", "Stopped at change " << next << " of " << changes->size());
+            return false;
+        }
+    }
+
+    LOG_INFO("APPLY", counts.inserted << " inserted, " << counts.updated << " updated, "
+             << counts.deleted << " deleted, " << counts.notFound << " not found; "
+             << counts.blocksRewritten << " blocks rewritten");
+    return true;
+}
+
+bool BSSFile::applyBlockChanges(int rbn, const std::vector<Change>& changes, size_t& next, ApplyStats& stats) {
+    BSSBlock block(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+    if (!readBlock(rbn, block)) {
+        LOG_ERROR("", "Error: Could not read block " << rbn);
+        return false;
+    }
+    BSSBlock::BlockHeader links = *block.getHeader();
+    ZipKey oldHighestKey = block.getHighestZipKey();
+
+    // Version 1 blocks hold their records in insertion order
+    std::vector<ZipCodeRecordBuffer> existing = block.unpackAllRecords();
+    std::stable_sort(existing.begin(), existing.end(), [](const auto& a, const auto& b) {
+        return a.getZipKey() < b.getZipKey();
+    });
+
+    // Merge the block's records with its changes: every key up to the block's
+    // highest, or all remaining keys for the last block (an empty block takes all)
+    bool takesRest = links.successorRBN == -1 || oldHighestKey.empty();
+    std::vector<ZipCodeRecordBuffer> merged;
+    merged.reserve(existing.size());
+    size_t e = 0;
+    while (next < changes.size()) {
+        const Change& change = changes[next];
+        ZipKey key = change.key();
+        if (!takesRest && key > oldHighestKey) break;
+        if (next + 1 < changes.size() && changes[next + 1].key() == key) {
+            next++;  // Superseded by a later change to the same key
+            continue;
+        }
+
+        while (e < existing.size() && existing[e].getZipKey() < key) merged.push_back(existing[e++]);
+        bool present = false;
+        while (e < existing.size() && existing[e].getZipKey() == key) {
+            present = true;
+            e++;
+            if (change.kind == Change::Kind::Delete) stats.deleted++;
+        }
+        if (change.kind == Change::Kind::Upsert) {
+            merged.push_back(change.record);
+            if (present) stats.updated++; else stats.inserted++;
+        } else if (!present) {
+            stats.notFound++;
+        }
+        next++;
+    }
+    merged.insert(merged.end(), existing.begin() + e, existing.end());
+
+    // Header and index follow only once the block's new contents are written
+    auto noteRewritten = [&]() {
+        header.setRecordCount(header.getRecordCount() + (uint32_t)merged.size() - (uint32_t)existing.size());
+        header.noteModification();
+        indexDirty = true;
+        index.removeEntry(oldHighestKey, rbn);
+    };
+
+    // Emptied: unlink the block, unless it is the only one
+    if (merged.empty() && (links.predecessorRBN != -1 || links.successorRBN != -1)) {
+        BSSBlock neighbour(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+        if (links.predecessorRBN != -1) {
+            if (!readBlock(links.predecessorRBN, neighbour)) return false;
+            neighbour.getHeader()->successorRBN = links.successorRBN;
+            if (!writeBlock(links.predecessorRBN, neighbour)) return false;
+        }
+        if (links.successorRBN != -1) {
+            if (!readBlock(links.successorRBN, neighbour)) return false;
+            neighbour.getHeader()->predecessorRBN = links.predecessorRBN;
+            if (!writeBlock(links.successorRBN, neighbour)) return false;
+        }
+        if (links.predecessorRBN == -1) header.setListHeadRBN(links.successorRBN);
+        noteRewritten();
+        addToAvailList(rbn);
+        writeHeader();
+        LOG_DEBUG("APPLY", "Block " << rbn << " emptied and added to avail list");
         return true;
-    } else {
-        std::cout << "[DELETE] Record " << zipCode << " deleted from block " << targetRBN 
-                  << " (" << records.size() << " records remain, below minimum of " << minRecords << ")\n";
-        
-        BSSBlock::BlockHeader* h = block.getHeader();
-        int adjacentRBN = -1;
-        
-        if (h->successorRBN != -1) {
-            adjacentRBN = h->successorRBN;
-        } else if (h->predecessorRBN != -1) {
-            adjacentRBN = h->predecessorRBN;
+    }
+
+    // Fits: rewrite in place, then fix an underflow like a delete would
+    if (fillBlock(block, merged)) {
+        if (!writeBlock(rbn, block)) return false;
+        noteRewritten();
+        stats.blocksRewritten++;
+        if (!merged.empty()) index.setEntry(block.getHighestZipKey(), rbn);
+        writeHeader();
+        if (!merged.empty() && isBelowMinCapacity(block)) {
+            return rebalanceBlock(rbn, block);
         }
-        
-        if (adjacentRBN == -1) {
+        return true;
+    }
+
+    // Too big: find how many full blocks the records need, then spread them
+    // evenly over that many (one more if uneven record sizes defeat that)
+    size_t pieces = 0;
+    for (size_t i = 0; i < merged.size(); ++pieces) {
+        block.clear();
+        while (i < merged.size() && block.addRecord(merged[i])) i++;
+        if (block.getHeader()->recordCount == 0) {
+            LOG_ERROR("", "Error: Record " << merged[i].getZipCode() << " does not fit in a "
+                      << blockSize << "-byte block");
+            return false;
+        }
+    }
+    std::vector<size_t> bounds;  // Piece p holds merged[bounds[p], bounds[p + 1])
+    for (;; ++pieces) {
+        bounds.assign(1, 0);
+        size_t i = 0;
+        for (size_t p = 0; p < pieces; ++p) {
+            size_t target = i + (merged.size() - i + (pieces - p) - 1) / (pieces - p);
             block.clear();
-            for (const auto& rec : records) {
-                block.addRecord(rec);
-            }
-            writeBlock(targetRBN, block);
-            header.setRecordCount(header.getRecordCount() - 1);
-            header.write(file);
-            std::cout << "[DELETE] Only one block in file, no redistribution possible\n";
-            return true;
+            while (i < target && block.addRecord(merged[i])) i++;
+            bounds.push_back(i);
         }
-        
-        // Check if we should merge or redistribute
-        BSSBlock adjacentBlock(blockSize);
-        if (!readBlock(adjacentRBN, adjacentBlock)) {
-            std::cerr << "Error: Could not read adjacent block\n";
+        if (i == merged.size()) break;
+    }
+
+    std::vector<int> rbns(pieces, rbn);
+    for (size_t p = 1; p < pieces; ++p) {
+        rbns[p] = getAvailBlock();
+        if (rbns[p] == -1) {
+            LOG_ERROR("", "Error: Could not get available block for split");
             return false;
         }
-        
-        if (shouldMerge(block, adjacentBlock)) {
-            std::cout << "[MERGE] Merging blocks " << targetRBN << " and " << adjacentRBN << "\n";
-            if (mergeBlocks(targetRBN, adjacentRBN)) {
-                header.setRecordCount(header.getRecordCount() - 1);
-                header.write(file);
-                return true;
-            }
-        } else {
-            std::cout << "[REDISTRIBUTE] Redistributing blocks " << targetRBN << " and " << adjacentRBN << "\n";
-            if (redistributeBlocks(targetRBN, adjacentRBN)) {
-                header.setRecordCount(header.getRecordCount() - 1);
-                header.write(file);
-                return true;
-            }
-        }
-        
-        std::cerr << "Error: Could not handle underflow\n";
-        return false;
     }
+    noteRewritten();
+    for (size_t p = 0; p < pieces; ++p) {
+        block.clear();
+        for (size_t i = bounds[p]; i < bounds[p + 1]; ++i) block.addRecord(merged[i]);
+        BSSBlock::BlockHeader* h = block.getHeader();
+        h->predecessorRBN = (p == 0) ? links.predecessorRBN : rbns[p - 1];
+        h->successorRBN = (p + 1 == pieces) ? links.successorRBN : rbns[p + 1];
+        if (!writeBlock(rbns[p], block)) return false;
+        index.setEntry(block.getHighestZipKey(), rbns[p]);
+    }
+    stats.blocksRewritten += (uint32_t)pieces;
+
+    if (links.successorRBN != -1) {
+        BSSBlock successor(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+        if (!readBlock(links.successorRBN, successor)) return false;
+        successor.getHeader()->predecessorRBN = rbns.back();
+        if (!writeBlock(links.successorRBN, successor)) return false;
+    }
+    writeHeader();
+    LOG_DEBUG("APPLY", "Block " << rbn << " split into " << pieces << " blocks");
+    return true;
 }
 
 int BSSFile::getAvailBlock() {
     int availRBN = header.getAvailHeadRBN();
     
     if (availRBN != -1) {
-        BSSBlock availBlock(blockSize);
+        BSSBlock availBlock(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
         if (readBlock(availRBN, availBlock)) {
             int nextAvailRBN = availBlock.getHeader()->successorRBN;
             header.setAvailHeadRBN(nextAvailRBN);
-            header.write(file);
+            writeHeader();
             
-            std::cout << "[AVAIL] Reusing block " << availRBN << " from avail list\n";
+            LOG_INFO("AVAIL", "Reusing block " << availRBN << " from avail list");
             return availRBN;
         }
     }
     
     int newRBN = header.getBlockCount();
     header.setBlockCount(newRBN + 1);
-    header.write(file);
+    writeHeader();
     
-    std::cout << "[NEW] Creating new block " << newRBN << "\n";
+    LOG_INFO("NEW", "Creating new block " << newRBN);
     return newRBN;
 }
 
 void BSSFile::addToAvailList(int rbn) {
-    BSSBlock block(blockSize);
+    BSSBlock block(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
     int currentAvailHead = header.getAvailHeadRBN();
     block.makeAvailBlock(currentAvailHead);
     writeBlock(rbn, block);
     header.setAvailHeadRBN(rbn);
-    header.write(file);
-    std::cout << "[AVAIL] Block " << rbn << " added to avail list\n";
+    writeHeader();
+    LOG_INFO("AVAIL", "Block " << rbn << " added to avail list");
 }
 
 bool BSSFile::splitBlock(int fullBlockRBN, const ZipCodeRecordBuffer& newRecord) {
-    BSSBlock fullBlock(blockSize);
+    BSSBlock fullBlock(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
     if (!readBlock(fullBlockRBN, fullBlock)) {
-        std::cerr << "Error: Could not read block " << fullBlockRBN << " for splitting\n";
+        LOG_ERROR("", "Error: Could not read block " << fullBlockRBN << " for splitting");
         return false;
     }
 
@@ -388,121 +1301,157 @@ bool BSSFile::splitBlock(int fullBlockRBN, const ZipCodeRecordBuffer& newRecord)
     records.push_back(newRecord);
     
     std::sort(records.begin(), records.end(), [](const auto& a, const auto& b) {
-        return a.getZipCode() < b.getZipCode();
+        return a.getZipKey() < b.getZipKey();
     });
 
-    size_t midPoint = records.size() / 2;
-    
-    BSSBlock block1(blockSize);
-    for (size_t i = 0; i < midPoint; ++i) {
-        if (!block1.addRecord(records[i])) {
-            std::cerr << "Error: Could not add record to block1 during split\n";
-            return false;
+    // Split at the middle record; with few, uneven records per block (small
+    // block sizes) the middle may not fit, so try the nearest points outward
+    BSSBlock block(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+    auto packRange = [&records, &block](size_t lo, size_t hi) {
+        block.clear();
+        for (size_t i = lo; i < hi; ++i) {
+            if (!block.addRecord(records[i])) return false;
+        }
+        return true;
+    };
+
+    long count = (long)records.size();
+    long midPoint = count / 2;
+    std::vector<size_t> bounds;  // First record of each resulting block, then count
+    for (long step = 0; step < 2 * count && bounds.empty(); ++step) {
+        // mid, mid+1, mid-1, mid+2, mid-2, ...
+        long split = (step % 2) ? midPoint + (step + 1) / 2 : midPoint - step / 2;
+        if (split < 1 || split >= count) continue;
+        if (packRange(0, split) && packRange(split, count)) {
+            bounds = {0, (size_t)split, (size_t)count};
         }
     }
-
-    int newBlockRBN = getAvailBlock();
-    if (newBlockRBN == -1) {
-        std::cerr << "Error: Could not get available block for split\n";
-        return false;
+    if (bounds.empty()) {
+        // A front-coded record that shares little with its neighbours can take
+        // most of a small block, so fill as many blocks as it takes
+        bounds.push_back(0);
+        block.clear();
+        for (size_t i = 0; i < records.size(); ++i) {
+            if (block.addRecord(records[i])) continue;
+            block.clear();
+            if (!block.addRecord(records[i])) {
+                LOG_ERROR("", "Error: Could not divide block " << fullBlockRBN << " between blocks during split");
+                return false;
+            }
+            bounds.push_back(i);
+        }
+        bounds.push_back(records.size());
     }
 
-    BSSBlock block2(blockSize);
-    for (size_t i = midPoint; i < records.size(); ++i) {
-        if (!block2.addRecord(records[i])) {
-            std::cerr << "Error: Could not add record to block2 during split\n";
+    std::vector<int> rbns = {fullBlockRBN};
+    while (rbns.size() + 1 < bounds.size()) {
+        int newBlockRBN = getAvailBlock();
+        if (newBlockRBN == -1) {
+            LOG_ERROR("", "Error: Could not get available block for split");
             return false;
         }
+        rbns.push_back(newBlockRBN);
     }
 
-    BSSBlock::BlockHeader* h1 = block1.getHeader();
-    BSSBlock::BlockHeader* h2 = block2.getHeader();
-    BSSBlock::BlockHeader* oldH = fullBlock.getHeader();
-
-    h1->predecessorRBN = oldH->predecessorRBN;
-    h1->successorRBN = newBlockRBN;
-    h2->predecessorRBN = fullBlockRBN;
-    h2->successorRBN = oldH->successorRBN;
-
-    if (!writeBlock(fullBlockRBN, block1)) {
-        std::cerr << "Error: Could not write block1 during split\n";
-        return false;
+    if (rbns.size() == 2) {
+        LOG_INFO("SPLIT", "Block " << fullBlockRBN << " split into blocks " << fullBlockRBN << " and " << rbns[1]);
+    } else {
+        LOG_INFO("SPLIT", "Block " << fullBlockRBN << " split into " << rbns.size() << " blocks");
     }
-    
-    if (!writeBlock(newBlockRBN, block2)) {
-        std::cerr << "Error: Could not write block2 during split\n";
-        return false;
+
+    BSSBlock::BlockHeader* oldH = fullBlock.getHeader();
+    index.removeEntry(fullBlock.getHighestZipKey(), fullBlockRBN);
+    for (size_t i = 0; i < rbns.size(); ++i) {
+        packRange(bounds[i], bounds[i + 1]);
+        block.getHeader()->predecessorRBN = (i == 0) ? oldH->predecessorRBN : rbns[i - 1];
+        block.getHeader()->successorRBN = (i + 1 < rbns.size()) ? rbns[i + 1] : oldH->successorRBN;
+        if (!writeBlock(rbns[i], block)) {
+            LOG_ERROR("", "Error: Could not write block " << rbns[i] << " during split");
+            return false;
+        }
+        index.setEntry(block.getHighestZipKey(), rbns[i]);
+        LOG_INFO("", "  Block " << rbns[i] << " now has " << block.getHeader()->recordCount
+                  << " records (highest: " << block.getHighestKey() << ")");
     }
 
-    if (h2->successorRBN != -1) {
-        BSSBlock nextBlock(blockSize);
-        if (readBlock(h2->successorRBN, nextBlock)) {
-            nextBlock.getHeader()->predecessorRBN = newBlockRBN;
-            writeBlock(h2->successorRBN, nextBlock);
+    if (oldH->successorRBN != -1) {
+        BSSBlock nextBlock(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+        if (readBlock(oldH->successorRBN, nextBlock)) {
+            nextBlock.getHeader()->predecessorRBN = rbns.back();
+            writeBlock(oldH->successorRBN, nextBlock);
         }
     }
 
-    if (h1->predecessorRBN != -1) {
-        BSSBlock prevBlock(blockSize);
-        if (readBlock(h1->predecessorRBN, prevBlock)) {
+    if (oldH->predecessorRBN != -1) {
+        BSSBlock prevBlock(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+        if (readBlock(oldH->predecessorRBN, prevBlock)) {
             prevBlock.getHeader()->successorRBN = fullBlockRBN;
-            writeBlock(h1->predecessorRBN, prevBlock);
+            writeBlock(oldH->predecessorRBN, prevBlock);
         }
     } else {
         header.setListHeadRBN(fullBlockRBN);
     }
 
     header.setRecordCount(header.getRecordCount() + 1);
-    header.write(file);
-
-    std::cout << "[SPLIT] Block " << fullBlockRBN << " split into blocks " 
-              << fullBlockRBN << " and " << newBlockRBN << "\n";
-    std::cout << "  Block " << fullBlockRBN << " now has " << h1->recordCount 
-              << " records (highest: " << block1.getHighestKey() << ")\n";
-    std::cout << "  Block " << newBlockRBN << " now has " << h2->recordCount 
-              << " records (highest: " << block2.getHighestKey() << ")\n";
-
+    header.noteModification();
+    indexDirty = true;
+    writeHeader();
     return true;
 }
 
-int BSSFile::findInsertionBlock(const std::string& zipCode) {
-    int rbn = header.getListHeadRBN();
-    
-    if (rbn == -1) {
-        std::cerr << "Error: No active blocks in file\n";
+int BSSFile::findInsertionBlock(ZipKey key) {
+    if (header.getListHeadRBN() == -1) {
+        LOG_ERROR("", "Error: No active blocks in file");
         return -1;
     }
 
-    BSSBlock block(blockSize);
-    
-    while (rbn != -1) {
-        if (!readBlock(rbn, block)) {
-            std::cerr << "Error: Could not read block " << rbn << "\n";
-            return -1;
-        }
+    ensureIndex();
 
-        std::string highestKey = block.getHighestKey();
-        int nextRBN = block.getHeader()->successorRBN;
+    // An empty index means every block is empty; the head block takes the record
+    int rbn = index.findRBN(key);
+    return (rbn != -1) ? rbn : header.getListHeadRBN();
+}
 
-        if (nextRBN == -1 || zipCode <= highestKey) {
-            return rbn;
-        }
+void BSSFile::ensureIndex() {
+    if (indexReady) return;
+    index.build(*this);
+    indexReady = true;
+}
 
-        rbn = nextRBN;
+void BSSFile::reindexBlock(ZipKey oldHighestKey, int rbn, const BSSBlock& block) {
+    index.removeEntry(oldHighestKey, rbn);
+    if (block.getHeader()->recordCount > 0) {
+        index.setEntry(block.getHighestZipKey(), rbn);
     }
+}
 
-    return -1;
+bool BSSFile::fillBlock(BSSBlock& block, const std::vector<ZipCodeRecordBuffer>& records) {
+    // clear() resets the links, so carry them over
+    BSSBlock::BlockHeader links = *block.getHeader();
+    block.clear();
+    block.getHeader()->predecessorRBN = links.predecessorRBN;
+    block.getHeader()->successorRBN = links.successorRBN;
+
+    for (const auto& rec : records) {
+        if (!block.addRecord(rec)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 bool BSSFile::redistributeBlocks(int rbn1, int rbn2) {
-    BSSBlock block1(blockSize);
-    BSSBlock block2(blockSize);
+    BSSBlock block1(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+    BSSBlock block2(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
     
     if (!readBlock(rbn1, block1) || !readBlock(rbn2, block2)) {
-        std::cerr << "Error: Could not read blocks for redistribution\n";
+        LOG_ERROR("", "Error: Could not read blocks for redistribution");
         return false;
     }
 
+    ZipKey oldHighest1 = block1.getHighestZipKey();
+    ZipKey oldHighest2 = block2.getHighestZipKey();
+
     std::vector<ZipCodeRecordBuffer> records1 = block1.unpackAllRecords();
     std::vector<ZipCodeRecordBuffer> records2 = block2.unpackAllRecords();
     
@@ -511,50 +1460,54 @@ bool BSSFile::redistributeBlocks(int rbn1, int rbn2) {
     allRecords.insert(allRecords.end(), records2.begin(), records2.end());
     
     std::sort(allRecords.begin(), allRecords.end(), [](const auto& a, const auto& b) {
-        return a.getZipCode() < b.getZipCode();
+        return a.getZipKey() < b.getZipKey();
     });
 
     size_t midPoint = allRecords.size() / 2;
+    std::vector<ZipCodeRecordBuffer> lower(allRecords.begin(), allRecords.begin() + midPoint);
+    std::vector<ZipCodeRecordBuffer> upper(allRecords.begin() + midPoint, allRecords.end());
     
-    block1.clear();
-    for (size_t i = 0; i < midPoint; ++i) {
-        if (!block1.addRecord(allRecords[i])) {
-            std::cerr << "Error: Could not add record to block1 during redistribution\n";
-            return false;
-        }
+    if (!fillBlock(block1, lower)) {
+        LOG_ERROR("", "Error: Could not add record to block1 during redistribution");
+        return false;
     }
 
-    block2.clear();
-    for (size_t i = midPoint; i < allRecords.size(); ++i) {
-        if (!block2.addRecord(allRecords[i])) {
-            std::cerr << "Error: Could not add record to block2 during redistribution\n";
-            return false;
-        }
+    if (!fillBlock(block2, upper)) {
+        LOG_ERROR("", "Error: Could not add record to block2 during redistribution");
+        return false;
     }
 
     if (!writeBlock(rbn1, block1) || !writeBlock(rbn2, block2)) {
-        std::cerr << "Error: Could not write blocks during redistribution\n";
+        LOG_ERROR("", "Error: Could not write blocks during redistribution");
         return false;
     }
 
-    std::cout << "[REDISTRIBUTE] Blocks " << rbn1 << " and " << rbn2 << " redistributed\n";
-    std::cout << "  Block " << rbn1 << ": " << block1.getHeader()->recordCount 
-              << " records (highest: " << block1.getHighestKey() << ")\n";
-    std::cout << "  Block " << rbn2 << ": " << block2.getHeader()->recordCount 
-              << " records (highest: " << block2.getHighestKey() << ")\n";
+    index.removeEntry(oldHighest1, rbn1);
+    index.removeEntry(oldHighest2, rbn2);
+    index.setEntry(block1.getHighestZipKey(), rbn1);
+    index.setEntry(block2.getHighestZipKey(), rbn2);
+
+    LOG_INFO("REDISTRIBUTE", "Blocks " << rbn1 << " and " << rbn2 << " redistributed");
+    LOG_INFO("", "  Block " << rbn1 << ": " << block1.getHeader()->recordCount 
+              << " records (highest: " << block1.getHighestKey() << ")");
+    LOG_INFO("", "  Block " << rbn2 << ": " << block2.getHeader()->recordCount 
+              << " records (highest: " << block2.getHighestKey() << ")");
 
     return true;
 }
 
 bool BSSFile::mergeBlocks(int rbn1, int rbn2) {
-    BSSBlock block1(blockSize);
-    BSSBlock block2(blockSize);
+    BSSBlock block1(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
+    BSSBlock block2(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
     
     if (!readBlock(rbn1, block1) || !readBlock(rbn2, block2)) {
-        std::cerr << "Error: Could not read blocks for merging\n";
+        LOG_ERROR("", "Error: Could not read blocks for merging");
         return false;
     }
 
+    ZipKey oldHighest1 = block1.getHighestZipKey();
+    ZipKey oldHighest2 = block2.getHighestZipKey();
+
     std::vector<ZipCodeRecordBuffer> records1 = block1.unpackAllRecords();
     std::vector<ZipCodeRecordBuffer> records2 = block2.unpackAllRecords();
     
@@ -563,15 +1516,12 @@ bool BSSFile::mergeBlocks(int rbn1, int rbn2) {
     allRecords.insert(allRecords.end(), records2.begin(), records2.end());
     
     std::sort(allRecords.begin(), allRecords.end(), [](const auto& a, const auto& b) {
-        return a.getZipCode() < b.getZipCode();
+        return a.getZipKey() < b.getZipKey();
     });
 
-    block1.clear();
-    for (const auto& rec : allRecords) {
-        if (!block1.addRecord(rec)) {
-            std::cerr << "Error: Could not add record to block1 during merge\n";
-            return false;
-        }
+    // Nothing has been written yet, so a merge that does not fit leaves the file untouched
+    if (!fillBlock(block1, allRecords)) {
+        return false;
     }
 
     BSSBlock::BlockHeader* h1 = block1.getHeader();
@@ -580,12 +1530,12 @@ bool BSSFile::mergeBlocks(int rbn1, int rbn2) {
     h1->successorRBN = h2->successorRBN;
 
     if (!writeBlock(rbn1, block1)) {
-        std::cerr << "Error: Could not write merged block\n";
+        LOG_ERROR("", "Error: Could not write merged block");
         return false;
     }
 
     if (h1->successorRBN != -1) {
-        BSSBlock nextBlock(blockSize);
+        BSSBlock nextBlock(blockSize, header.getVersion(), header.getRecordEncoding(), &dictionary);
         if (readBlock(h1->successorRBN, nextBlock)) {
             nextBlock.getHeader()->predecessorRBN = rbn1;
             writeBlock(h1->successorRBN, nextBlock);
@@ -594,21 +1544,21 @@ bool BSSFile::mergeBlocks(int rbn1, int rbn2) {
 
     addToAvailList(rbn2);
 
-    std::cout << "[MERGE] Blocks " << rbn1 << " and " << rbn2 << " merged into block " << rbn1 << "\n";
-    std::cout << "  Merged block " << rbn1 << " now has " << h1->recordCount 
-              << " records (highest: " << block1.getHighestKey() << ")\n";
-    std::cout << "  Block " << rbn2 << " cleared and added to avail list\n";
+    index.removeEntry(oldHighest1, rbn1);
+    index.removeEntry(oldHighest2, rbn2);
+    index.setEntry(block1.getHighestZipKey(), rbn1);
+
+    LOG_INFO("MERGE", "Blocks " << rbn1 << " and " << rbn2 << " merged into block " << rbn1);
+    LOG_INFO("", "  Merged block " << rbn1 << " now has " << h1->recordCount 
+              << " records (highest: " << block1.getHighestKey() << ")");
+    LOG_INFO("", "  Block " << rbn2 << " cleared and added to avail list");
 
     return true;
 }
 
 bool BSSFile::shouldMerge(const BSSBlock& block1, const BSSBlock& block2) const {
-    uint32_t totalRecords = block1.getHeader()->recordCount + block2.getHeader()->recordCount;
-    uint32_t headerSize = sizeof(BSSBlock::BlockHeader);
-    uint32_t availableSpace = blockSize - headerSize;
-    uint32_t avgRecordSize = 70;
-    uint32_t maxRecords = availableSpace / avgRecordSize;
-    return totalRecords <= maxRecords;
+    // Exact byte count, since per-record overhead differs between block formats
+    return block1.getUsedBytes() + block2.getUsedBytes() <= block1.getCapacityBytes();
 }
 
 bool BSSFile::isBelowMinCapacity(const BSSBlock& block) const {
@@ -617,9 +1567,17 @@ bool BSSFile::isBelowMinCapacity(const BSSBlock& block) const {
 }
 
 uint32_t BSSFile::getMinRecordCount() const {
-    uint32_t headerSize = sizeof(BSSBlock::BlockHeader);
+    uint32_t headerSize = (header.getVersion() >= BSS_VERSION_SLOTTED)
+                              ? sizeof(BSSBlock::BlockHeader)
+                              : BSSBlock::LENGTH_PREFIXED_HEADER_SIZE;
     uint32_t availableSpace = blockSize - headerSize;
     uint32_t avgRecordSize = 62;
+    if (header.getRecordEncoding() == RecordEncoding::BinaryFixed) {
+        avgRecordSize -= 9; // int32 coordinates save about this much over their text form
+    }
+    if (header.getVersion() == BSS_VERSION_FRONT_CODED) {
+        avgRecordSize = avgRecordSize * 5 / 8; // Entries shed the prefixes they share with their predecessor
+    }
     uint32_t maxRecords = availableSpace / avgRecordSize;
     uint32_t minRecords = maxRecords / 2;
     return (minRecords > 0) ? minRecords : 1;
@@ -627,4 +1585,187 @@ uint32_t BSSFile::getMinRecordCount() const {
 
 const BSSFileHeader& BSSFile::getHeader() const {
     return header;
-}
\ No newline at end of file
+}
+
+const BSSIndex& BSSFile::getIndex() {
+    if (file.is_open()) ensureIndex();
+    return index;
+}
+
+bool BSSFile::loadIndex(const std::string& indexFilename) {
+    if (!file.is_open()) return false;
+    indexPath = indexFilename;
+
+    std::ifstream probe(indexFilename, std::ios::binary);
+    bool exists = probe.good();
+    probe.close();
+
+    BSSIndex loaded;
+    if (exists && loaded.read(indexFilename)) {
+        if (loaded.getSourceGeneration() == header.getGeneration()) {
+            index = loaded;
+            indexReady = true;
+            indexDirty = false;
+            return true;
+        }
+        LOG_WARN("", "Index '" << indexFilename << "' is stale (built for another version of the file); rebuilding");
+    } else if (!exists) {
+        LOG_INFO("", "Index '" << indexFilename << "' not found; building it");
+    } else {
+        LOG_WARN("", "Index '" << indexFilename << "' is unreadable; rebuilding");
+    }
+
+    index.build(*this);
+    indexReady = true;
+    indexDirty = true;
+    return saveIndex();
+}
+
+bool BSSFile::saveIndex() {
+    if (indexPath.empty() || !indexReady) return false;
+    if (!index.write(indexPath, header.getGeneration())) return false;
+    indexDirty = false;
+    return true;
+}
+
+void BSSFile::beginOperation() {
+    inOperation = true;
+    headerBefore = header;
+    dictionaryBefore = dictionary.mark();
+    pendingBlocks.clear();
+}
+
+bool BSSFile::commitOperation() {
+    // New State/County values travel in the same log record as the blocks using them
+    if (dictionary.isDirty() && !saveDictionary()) {
+        LOG_ERROR("DICT", "Failed to write the dictionary of " << filePath);
+        return abortOperation();
+    }
+    inOperation = false;
+
+    // One record: the header followed by every changed block
+    size_t headerBytes = std::min(sizeof(BSSFileHeader), (size_t)header.getHeaderBlockCount() * blockSize);
+    std::vector<WriteAheadLog::Page> pages;
+    pages.reserve(pendingBlocks.size() + 1);
+    pages.push_back({0, reinterpret_cast<const char*>(&header), (uint32_t)headerBytes});
+    for (const auto& entry : pendingBlocks) {
+        pages.push_back({(uint64_t)entry.first * blockSize, entry.second.data(), blockSize});
+        unsyncedBlocks.insert(entry.first);
+    }
+    wal.append(pages);
+    headerDirty = true;
+
+    // The cache's write-back guard syncs the log before any of these reaches the file
+    bool ok = true;
+    for (const auto& entry : pendingBlocks) {
+        char* frame = cache.pin(entry.first, false);
+        if (!frame) {
+            LOG_ERROR("WAL", "Could not cache block " << entry.first << " after logging it");
+            ok = false;
+            continue;
+        }
+        memcpy(frame, entry.second.data(), blockSize);
+        cache.unpin(entry.first, true);
+    }
+    pendingBlocks.clear();
+    if (!ok) return false;
+
+    if (wal.getUnsyncedCount() >= groupCommitSize && !syncLog()) return false;
+    if (wal.getSize() >= CHECKPOINT_BYTES) return sync();
+    return true;
+}
+
+bool BSSFile::abortOperation() {
+    inOperation = false;
+    header = headerBefore;
+    dictionary.rollback(dictionaryBefore);
+    if (!pendingBlocks.empty()) {
+        // The live index may already point at blocks that were never written
+        pendingBlocks.clear();
+        index.clear();
+        indexReady = false;
+    }
+    return false;
+}
+
+bool BSSFile::loadDictionary() {
+    dictionary.clear();
+    dictionaryRBNs.clear();
+    if (header.getRecordEncoding() != RecordEncoding::BinaryDictionary) return true;
+
+    std::vector<char> image;
+    BSSBlock block(blockSize, header.getVersion());
+    int rbn = (int)header.getDictionaryRBN();
+    while (rbn > 0 && dictionaryRBNs.size() < header.getBlockCount()) {
+        if (!readBlock(rbn, block) || block.getHeader()->blockType != 'D') {
+            LOG_ERROR("DICT", "Block " << rbn << " is not a dictionary block");
+            return false;
+        }
+        image.insert(image.end(), block.getDictionaryData(),
+                     block.getDictionaryData() + block.getDictionaryCapacity());
+        dictionaryRBNs.push_back(rbn);
+        rbn = block.getHeader()->successorRBN;
+    }
+    if (!dictionary.load(image.data(), image.size())) return false;
+    LOG_DEBUG("DICT", "Loaded " << dictionary.size(FieldDictionary::STATE) << " states and "
+              << dictionary.size(FieldDictionary::COUNTY) << " counties from " << dictionaryRBNs.size() << " blocks");
+    return true;
+}
+
+bool BSSFile::saveDictionary() {
+    const std::vector<char>& image = dictionary.getImage();
+    BSSBlock block(blockSize, header.getVersion());
+    size_t capacity = block.getDictionaryCapacity();
+    size_t needed = (image.size() + capacity - 1) / capacity;
+
+    // The old last block changes too when the chain grows (its successor link)
+    size_t oldCount = dictionaryRBNs.size();
+    size_t firstChanged = dictionary.getSavedBytes() / capacity;
+    if (oldCount > 0) firstChanged = std::min(firstChanged, oldCount - 1);
+    while (dictionaryRBNs.size() < needed) {
+        dictionaryRBNs.push_back(getAvailBlock());
+    }
+
+    for (size_t i = 0; i < needed; ++i) {
+        if (i != 0 && i < firstChanged) continue;  // Block 0 holds the image header
+        int next = (i + 1 < needed) ? dictionaryRBNs[i + 1] : -1;
+        size_t offset = i * capacity;
+        block.makeDictionaryBlock(next, image.data() + offset, (uint32_t)std::min(capacity, image.size() - offset));
+        if (!writeBlock(dictionaryRBNs[i], block)) return false;
+    }
+    if (header.getDictionaryRBN() != (uint32_t)dictionaryRBNs[0]) {
+        header.setDictionaryRBN((uint32_t)dictionaryRBNs[0]);
+        writeHeader();
+    }
+    LOG_DEBUG("DICT", "Saved dictionary: " << image.size() << " bytes in " << needed << " blocks");
+    dictionary.markSaved();
+    return true;
+}
+
+bool BSSFile::writeHeader() {
+    if (!wal.isOpen()) return header.write(file);
+    if (inOperation) return true;  // Logged with the operation's blocks
+    beginOperation();
+    return commitOperation();
+}
+
+bool BSSFile::syncLog() {
+    if (!wal.sync()) return false;
+    unsyncedBlocks.clear();
+    return true;
+}
+
+bool BSSFile::sync() {
+    if (!file.is_open()) return false;
+    if (!wal.isOpen()) return flush();
+    if (!syncLog() || !flush()) {
+        LOG_ERROR("WAL", "Checkpoint of " << filePath << " failed");
+        return false;
+    }
+    file.flush();
+    if (!file.good() || !WriteAheadLog::syncFile(filePath)) {
+        LOG_ERROR("WAL", "Failed to sync " << filePath);
+        return false;
+    }
+    return wal.reset();
+}
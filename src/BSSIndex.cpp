@@ -2,6 +2,9 @@
 #include "../headers/BSSFile.h"
 #include "../headers/BSSBlock.h"
 #include "../headers/BSSFileHeader.h"
+#include "../headers/Log.h"
+#include <algorithm>
+#include <type_traits>
 #include <iostream>
 
 /**
@@ -9,57 +12,53 @@
  * @param bssFile The opened BSS file to index
  */
 void BSSIndex::build(BSSFile& bssFile) {
-    std::cout << "[BSSIndex::build] Starting index build..." << std::endl;
-    std::cout.flush();
-    indexMap.clear();
+    LOG_DEBUG("BSSIndex::build", "Starting index build...");
+    clear();
     
-    std::cout << "[BSSIndex::build] Getting header..." << std::endl;
-    std::cout.flush();
+    LOG_DEBUG("BSSIndex::build", "Getting header...");
     const BSSFileHeader& header = bssFile.getHeader();
     
-    std::cout << "[BSSIndex::build] Header info: blockSize=" << header.getBlockSize()
+    LOG_DEBUG("BSSIndex::build", "Header info: blockSize=" << header.getBlockSize()
               << ", blockCount=" << header.getBlockCount()
-              << ", listHeadRBN=" << header.getListHeadRBN() << std::endl;
-    std::cout.flush();
+              << ", listHeadRBN=" << header.getListHeadRBN());
     
     int rbn = header.getListHeadRBN();
     
     if (rbn == -1) {
-        std::cout << "No active blocks in sequence set (listHeadRBN = -1).\n";
-        std::cout << "Index built with 0 entries.\n";
+        LOG_INFO("", "No active blocks in sequence set (listHeadRBN = -1).");
+        LOG_INFO("", "Index built with 0 entries.");
         return;
     }
     
-    std::cout << "[BSSIndex::build] Starting to process blocks from RBN " << rbn << "..." << std::endl;
-    std::cout.flush();
+    LOG_DEBUG("BSSIndex::build", "Starting to process blocks from RBN " << rbn << "...");
 
     int blocksProcessed = 0;
-    const int MAX_BLOCKS = 10000;  // Safety limit to prevent infinite loops
+    std::vector<std::pair<ZipKey, int>> entries;
+    // Safety limit to prevent infinite loops: a valid chain never visits more blocks than the file has
+    const int MAX_BLOCKS = (int)header.getBlockCount();
 
     while (rbn != -1 && blocksProcessed < MAX_BLOCKS) {
-        std::cout << "[BSSIndex::build] Processing block " << rbn << " (block " << (blocksProcessed+1) << ")..." << std::endl;
-        std::cout.flush();
+        LOG_TRACE("BSSIndex::build", "Processing block " << rbn << " (block " << (blocksProcessed+1) << ")...");
         
         BSSBlock block(header.getBlockSize());
         
-        std::cout << "[BSSIndex::build] Reading block " << rbn << "..." << std::endl;
-        std::cout.flush();
+        LOG_TRACE("BSSIndex::build", "Reading block " << rbn << "...");
         
         if (!bssFile.readBlock(rbn, block)) {
-            std::cerr << "Error reading block " << rbn << " during index build.\n";
+            LOG_ERROR("", "Error reading block " << rbn << " during index build.");
             break;
         }
 
-        std::string highestKey = block.getHighestKey();
+        ZipKey highestKey = block.getHighestZipKey();
         if (!highestKey.empty()) {
-            indexMap[highestKey] = rbn;
+            entries.emplace_back(highestKey, rbn);
         } else {
-            std::cerr << "Warning: Block " << rbn << " has no highest key (empty block?).\n";
+            LOG_WARN("", "Warning: Block " << rbn << " has no highest key (empty block?).");
         }
 
         int nextRBN = block.getHeader()->successorRBN;
         if (nextRBN == rbn) {
-            std::cerr << "Error: Block " << rbn << " points to itself! Breaking loop.\n";
+            LOG_ERROR("", "Error: Block " << rbn << " points to itself! Breaking loop.");
             break;
         }
         
@@ -68,11 +67,58 @@ void BSSIndex::build(BSSFile& bssFile) {
     }
     
     if (blocksProcessed >= MAX_BLOCKS) {
-        std::cerr << "Warning: Stopped after " << MAX_BLOCKS << " blocks (possible infinite loop).\n";
+        LOG_WARN("", "Warning: Stopped after " << MAX_BLOCKS << " blocks (possible infinite loop).");
     }
 
-    std::cout << "Index built with " << indexMap.size() << " entries from "
-              << blocksProcessed << " blocks.\n";
+    assign(entries);
+    LOG_INFO("", "Index built with " << size() << " entries from "
+              << blocksProcessed << " blocks.");
+}
+
+// Mapped key sections are read as ZipKey arrays, so ZipKey must be a bare uint64
+static_assert(sizeof(ZipKey) == sizeof(uint64_t) && std::is_standard_layout<ZipKey>::value,
+              "ZipKey must have the layout of its packed value");
+
+const char BSSIndex::FILE_MAGIC[8] = {'B', 'S', 'S', 'I', 'D', 'X', '\0', '\0'};
+
+const ZipKey* BSSIndex::keyData() const {
+    return mapped ? reinterpret_cast<const ZipKey*>(mapped->keys()) : keys.data();
+}
+
+const int32_t* BSSIndex::rbnData() const {
+    return mapped ? reinterpret_cast<const int32_t*>(mapped->values()) : rbns.data();
+}
+
+/**
+ * @brief Copies the entries out of the mapped file so the index can be modified
+ */
+void BSSIndex::detach() {
+    if (!mapped) return;
+    size_t n = size();
+    keys.assign(keyData(), keyData() + n);
+    rbns.assign(rbnData(), rbnData() + n);
+    mapped.reset();
+}
+
+/**
+ * @brief Finds the first entry whose key is not less than the given key
+ * @param key The key to search for
+ * @return Position in the entry arrays, or size() if every key is smaller
+ */
+size_t BSSIndex::lowerBound(ZipKey key) const {
+    size_t n = size();
+    if (n == 0) return 0;
+
+    // Branchless binary search: the compare feeds a conditional move, not a jump
+    uint64_t probe = key.value();
+    const ZipKey* first = keyData();
+    const ZipKey* base = first;
+    while (n > 1) {
+        size_t half = n / 2;
+        base = (base[half].value() < probe) ? base + half : base;
+        n -= half;
+    }
+    return static_cast<size_t>(base - first) + (base->value() < probe);
 }
 
 /**
@@ -80,68 +126,141 @@ void BSSIndex::build(BSSFile& bssFile) {
  * @param key The key to search for
  * @return RBN of the block, or -1 if not found
  */
-int BSSIndex::findRBN(const std::string& key) const {
-    if (indexMap.empty()) return -1;
+int BSSIndex::findRBN(ZipKey key) const {
+    size_t n = size();
+    if (n == 0) return -1;
 
     // Find the first block whose highest key >= search key
-    auto it = indexMap.lower_bound(key);
-    
-    if (it == indexMap.end()) {
+    size_t pos = lowerBound(key);
+
+    if (pos == n) {
         // Key is larger than all highest keys, check last block
-        if (!indexMap.empty()) {
-            return indexMap.rbegin()->second;
+        return rbnData()[n - 1];
+    }
+
+    return rbnData()[pos];
+}
+
+/**
+ * @brief Removes all entries
+ */
+void BSSIndex::clear() {
+    keys.clear();
+    rbns.clear();
+    mapped.reset();
+    sourceGeneration = 0;
+}
+
+/**
+ * @brief Replaces the index contents with the given entries
+ * @param entries (highest key, RBN) pairs in any order; consumed
+ */
+void BSSIndex::assign(std::vector<std::pair<ZipKey, int>>& entries) {
+    clear();
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const std::pair<ZipKey, int>& a, const std::pair<ZipKey, int>& b) {
+                         return a.first < b.first;
+                     });
+
+    keys.reserve(entries.size());
+    rbns.reserve(entries.size());
+    for (const auto& entry : entries) {
+        // Equal keys: the later entry wins, as repeated setEntry calls would
+        if (!keys.empty() && keys.back() == entry.first) {
+            rbns.back() = entry.second;
+            continue;
         }
-        return -1;
+        keys.push_back(entry.first);
+        rbns.push_back(entry.second);
     }
+    entries.clear();
+}
+
+/**
+ * @brief Records that the block at rbn now has the given highest key
+ * @param highestKey The block's highest key
+ * @param rbn The RBN of the block
+ */
+void BSSIndex::setEntry(ZipKey highestKey, int rbn) {
+    if (highestKey.empty()) return;
+    detach();
 
-    return it->second;
+    size_t pos = lowerBound(highestKey);
+    if (pos < keys.size() && keys[pos] == highestKey) {
+        rbns[pos] = rbn;
+        return;
+    }
+    keys.insert(keys.begin() + pos, highestKey);
+    rbns.insert(rbns.begin() + pos, rbn);
+}
+
+/**
+ * @brief Removes the entry for highestKey if it still points at rbn
+ * @param highestKey The block's previous highest key
+ * @param rbn The RBN of the block
+ */
+void BSSIndex::removeEntry(ZipKey highestKey, int rbn) {
+    detach();
+    size_t pos = lowerBound(highestKey);
+    if (pos < keys.size() && keys[pos] == highestKey && rbns[pos] == rbn) {
+        keys.erase(keys.begin() + pos);
+        rbns.erase(rbns.begin() + pos);
+    }
 }
 
 /**
  * @brief Writes the index to a binary file
  * @param filename The index file name
+ * @param sourceGeneration Generation of the .bss file the index describes
  * @return true on success
  */
-bool BSSIndex::write(const std::string& filename) const {
-    std::ofstream out(filename, std::ios::binary);
-    if (!out) {
-        std::cerr << "Error: Cannot open " << filename << " for writing.\n";
-        return false;
-    }
-
-    uint32_t count = static_cast<uint32_t>(indexMap.size());
-    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+bool BSSIndex::write(const std::string& filename, uint64_t sourceGeneration) const {
+    return IndexFile::write(filename, FILE_MAGIC, reinterpret_cast<const uint64_t*>(keyData()),
+                            rbnData(), sizeof(int32_t), size(), sourceGeneration);
+}
 
-    for (const auto& entry : indexMap) {
-        uint16_t keyLen = static_cast<uint16_t>(entry.first.size());
-        out.write(reinterpret_cast<const char*>(&keyLen), sizeof(keyLen));
-        out.write(entry.first.c_str(), keyLen);
-        
-        int rbn = entry.second;
-        out.write(reinterpret_cast<const char*>(&rbn), sizeof(rbn));
+/**
+ * @brief Reads the index from a binary file
+ * @param filename The index file name
+ * @return true on success
+ * @note Current-format files are mapped, not parsed.
+ */
+bool BSSIndex::read(const std::string& filename) {
+    if (!IndexFile::hasMagic(filename, FILE_MAGIC)) {
+        return readLegacy(filename);
     }
 
-    out.close();
+    clear();
+    std::shared_ptr<IndexFile> file = std::make_shared<IndexFile>();
+    if (!file->open(filename, FILE_MAGIC, sizeof(int32_t))) {
+        return false;
+    }
+    mapped = file;
+    sourceGeneration = file->getSourceGeneration();
+    LOG_INFO("", "Loaded BSS index with " << size() << " entries.");
     return true;
 }
 
 /**
- * @brief Reads the index from a binary file
+ * @brief Reads a version 1 index file ([count] then [keyLen][key][rbn] per entry)
  * @param filename The index file name
  * @return true on success
  */
-bool BSSIndex::read(const std::string& filename) {
+bool BSSIndex::readLegacy(const std::string& filename) {
     std::ifstream in(filename, std::ios::binary);
     if (!in) {
-        std::cerr << "Error: Cannot open " << filename << " for reading.\n";
+        LOG_ERROR("", "Error: Cannot open " << filename << " for reading.");
         return false;
     }
 
-    indexMap.clear();
+    clear();
 
     uint32_t count = 0;
     in.read(reinterpret_cast<char*>(&count), sizeof(count));
 
+    std::vector<std::pair<ZipKey, int>> entries;
+    entries.reserve(count);
+
     for (uint32_t i = 0; i < count; ++i) {
         uint16_t keyLen = 0;
         in.read(reinterpret_cast<char*>(&keyLen), sizeof(keyLen));
@@ -152,11 +271,12 @@ bool BSSIndex::read(const std::string& filename) {
         int rbn = 0;
         in.read(reinterpret_cast<char*>(&rbn), sizeof(rbn));
 
-        indexMap[key] = rbn;
+        entries.emplace_back(ZipKey(key), rbn);
     }
+    assign(entries);
 
     in.close();
-    std::cout << "Loaded BSS index with " << count << " entries.\n";
+    LOG_INFO("", "Loaded BSS index with " << count << " entries.");
     return true;
 }
 
@@ -166,11 +286,11 @@ bool BSSIndex::read(const std::string& filename) {
  */
 void BSSIndex::dump(std::ostream& os) const {
     os << "\n--- BSS Index Dump ---\n";
-    os << "Total entries: " << indexMap.size() << "\n\n";
+    os << "Total entries: " << size() << "\n\n";
     
-    for (const auto& entry : indexMap) {
-        os << "Key: " << entry.first << " -> RBN: " << entry.second << "\n";
+    for (size_t i = 0; i < size(); ++i) {
+        os << "Key: " << keyData()[i].toString() << " -> RBN: " << rbnData()[i] << "\n";
     }
     
     os << "---------------------\n";
-}
\ No newline at end of file
+}
@@ -0,0 +1,746 @@
+#include "../headers/Benchmark.h"
+#include "../headers/BSSFile.h"
+#include "../headers/BSSIndex.h"
+#include "../headers/RecordView.h"
+#include "../headers/HeaderBuffer.h"
+#include "../headers/Log.h"
+#include "../headers/convertCSV.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+
+namespace {
+
+// Discards everything written to it
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+// Mutes std::cout for its lifetime; info logging is switched off so timed loops skip formatting it
+class QuietCout {
+public:
+    QuietCout() : saved(std::cout.rdbuf(&sink)), level(Log::Level::Warn) {}
+    ~QuietCout() { std::cout.rdbuf(saved); }
+
+private:
+    NullBuffer sink;
+    std::streambuf* saved;
+    Log::ScopedLevel level;
+};
+
+struct LookupResult {
+    bool ok = false;
+    double seconds = 0.0;
+    size_t found = 0;
+    double checksum = 0.0;   // Keeps the record access from being optimized away
+    CacheStats cacheStats;
+};
+
+// Every key in the file, in sequence set order
+std::vector<std::string> collectKeys(const std::string& bssFile) {
+    std::vector<std::string> keys;
+    QuietCout quiet;
+    BSSFile file;
+    if (!file.open(bssFile, BSSFile::OpenMode::MappedReadOnly)) return keys;
+
+    file.adviseAccess(BSSFile::AccessPattern::Sequential);
+    BSSBlock block(file.getHeader().getBlockSize(), file.getHeader().getVersion());
+    int rbn = file.getHeader().getListHeadRBN();
+    while (rbn != -1 && file.readBlock(rbn, block)) {
+        for (const RecordView& rec : block) {
+            keys.emplace_back(rec.getZipCode());
+        }
+        rbn = block.getHeader()->successorRBN;
+    }
+    file.close();
+    return keys;
+}
+
+// Index probe + block read + in-block search for every key
+LookupResult timeLookups(const std::string& bssFile, BSSFile::OpenMode mode,
+                         const std::vector<std::string>& probes) {
+    LookupResult result;
+    QuietCout quiet;
+    BSSFile file;
+    if (!file.open(bssFile, mode)) return result;
+
+    // Index construction is not part of the measurement
+    BSSIndex index = file.getIndex();
+    file.setCacheOptions(64, BlockCache::Policy::LRU);
+    file.resetCacheStats();
+    BSSBlock block(file.getHeader().getBlockSize(), file.getHeader().getVersion());
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& key : probes) {
+        int rbn = index.findRBN(key);
+        if (rbn == -1 || !file.readBlock(rbn, block)) continue;
+        RecordView rec;
+        if (block.findRecord(std::string_view(key), rec)) {
+            result.found++;
+            result.checksum += rec.getLatitude();
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    result.seconds = std::chrono::duration<double>(stop - start).count();
+    result.cacheStats = file.getCacheStats();
+    result.ok = true;
+    file.close();
+    return result;
+}
+
+// Same probes answered by one lookupBatch call
+LookupResult timeBatch(const std::string& bssFile, BSSFile::OpenMode mode,
+                       const std::vector<std::string>& probes) {
+    LookupResult result;
+    QuietCout quiet;
+    BSSFile file;
+    if (!file.open(bssFile, mode)) return result;
+
+    BSSIndex index = file.getIndex();
+    file.setCacheOptions(64, BlockCache::Policy::LRU);
+    file.resetCacheStats();
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<BSSFile::LookupResult> answers = file.lookupBatch(probes, index);
+    auto stop = std::chrono::steady_clock::now();
+
+    for (const auto& answer : answers) {
+        if (!answer.found) continue;
+        result.found++;
+        result.checksum += answer.record.getLatitude();
+    }
+    result.seconds = std::chrono::duration<double>(stop - start).count();
+    result.cacheStats = file.getCacheStats();
+    result.ok = true;
+    file.close();
+    return result;
+}
+
+// Writes a .dat file holding every record of datFile `replicas` times
+bool replicateDatFile(const std::string& datFile, const std::string& outFile, unsigned replicas) {
+    std::ifstream in(datFile, std::ios::binary);
+    HeaderRecordBuffer header;
+    if (!in || !header.readHeader(in)) return false;
+    std::vector<char> body((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    std::ofstream out(outFile, std::ios::binary | std::ios::trunc);
+    header.recordCount *= replicas;
+    header.writeHeader(out);
+    for (unsigned r = 0; r < replicas; ++r) {
+        out.write(body.data(), body.size());
+    }
+    return out.good();
+}
+
+// Writes a CSV file with the header row of csvFile and its other lines `replicas` times
+bool replicateCsvFile(const std::string& csvFile, const std::string& outFile, unsigned replicas) {
+    std::ifstream in(csvFile, std::ios::binary);
+    std::string headerRow;
+    if (!in || !std::getline(in, headerRow)) return false;
+    std::vector<char> body((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (!body.empty() && body.back() != '\n') body.push_back('\n');
+
+    std::ofstream out(outFile, std::ios::binary | std::ios::trunc);
+    out << headerRow << '\n';
+    for (unsigned r = 0; r < replicas; ++r) {
+        out.write(body.data(), body.size());
+    }
+    return out.good();
+}
+
+std::vector<char> readWholeFile(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+// New records whose keys are not in the file yet
+std::vector<ZipCodeRecordBuffer> makeInsertRecords(const std::vector<std::string>& existingKeys, size_t count) {
+    std::set<std::string> taken(existingKeys.begin(), existingKeys.end());
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> pick(0, 99999);
+    std::vector<ZipCodeRecordBuffer> records;
+    while (records.size() < count && taken.size() < 100000) {
+        char zip[6];
+        std::snprintf(zip, sizeof(zip), "%05d", pick(rng));
+        if (!taken.insert(zip).second) continue;
+        ZipCodeRecordBuffer rec;
+        rec.unpack(std::string(zip) + ",Benchmark Place,ZZ,Benchmark County,40.0000,-75.0000");
+        records.push_back(rec);
+    }
+    return records;
+}
+
+size_t fileSize(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    return in ? (size_t)in.tellg() : 0;
+}
+
+void printResult(const std::string& label, const LookupResult& result, size_t lookupCount) {
+    double perSecond = result.seconds > 0 ? lookupCount / result.seconds : 0.0;
+    double nsPerLookup = lookupCount ? result.seconds * 1e9 / lookupCount : 0.0;
+    std::cout << std::left << std::setw(26) << label << std::right
+              << std::fixed << std::setprecision(0)
+              << std::setw(12) << perSecond << " lookups/s "
+              << std::setw(8) << nsPerLookup << " ns/lookup  "
+              << result.found << "/" << lookupCount << " found\n";
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+}
+
+// Fixed-width decimal key, like a ZIP code but wide enough for n distinct values
+std::string makeIndexKey(uint64_t value, int width) {
+    std::string key(width, '0');
+    for (int i = width - 1; i >= 0 && value > 0; --i, value /= 10) {
+        key[i] = char('0' + value % 10);
+    }
+    return key;
+}
+
+// The pre-flat BSSIndex::findRBN, kept here as the baseline
+int mapFindRBN(const std::map<std::string, int>& index, const std::string& key) {
+    if (index.empty()) return -1;
+    auto it = index.lower_bound(key);
+    if (it == index.end()) return index.rbegin()->second;
+    return it->second;
+}
+
+bool copyFile(const std::string& from, const std::string& to) {
+    std::vector<char> bytes = readWholeFile(from);
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+    return !bytes.empty() && out.good();
+}
+
+// A daily-delta style change set: new keys, replaced records and deletes (some of absent keys)
+std::vector<BSSFile::Change> makeChangeSet(const std::vector<std::string>& existingKeys, size_t count) {
+    std::mt19937 rng(13);
+    std::uniform_int_distribution<size_t> pickExisting(0, existingKeys.size() - 1);
+    std::uniform_int_distribution<int> pickZip(0, 99999);
+    std::uniform_int_distribution<int> pickKind(0, 9);
+    std::vector<BSSFile::Change> changes;
+    changes.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        int kind = pickKind(rng);
+        char zip[6];
+        std::snprintf(zip, sizeof(zip), "%05d", pickZip(rng));
+        std::string key = (kind < 4) ? std::string(zip) : existingKeys[pickExisting(rng)];
+        if (kind >= 7) {
+            changes.push_back(BSSFile::Change::erase(key));
+        } else {
+            ZipCodeRecordBuffer rec;
+            rec.unpack(key + ",Benchmark Place,ZZ,Benchmark County,40.0000,-75.0000");
+            changes.push_back(BSSFile::Change::upsert(rec));
+        }
+    }
+    std::stable_sort(changes.begin(), changes.end(), [](const auto& a, const auto& b) {
+        return a.key() < b.key();
+    });
+    return changes;
+}
+
+struct ApplyResult {
+    bool ok = false;
+    double seconds = 0.0;
+    uint64_t blockWrites = 0;
+};
+
+// Applies changes to a fresh copy of bssFile, record by record or as one applyChanges call
+ApplyResult timeApply(const std::string& bssFile, const std::string& scratch,
+                      const std::vector<BSSFile::Change>& changes, bool batched) {
+    ApplyResult result;
+    if (!copyFile(bssFile, scratch)) return result;
+    QuietCout quiet;
+    BSSFile file;
+    if (!file.open(scratch)) return result;
+    file.getIndex(); // Index build is not part of the measurement
+    file.resetCacheStats();
+
+    auto start = std::chrono::steady_clock::now();
+    if (batched) {
+        result.ok = file.applyChanges(changes);
+    } else {
+        result.ok = true;
+        for (const auto& change : changes) {
+            // Upsert = drop the old record (if any), then add
+            std::string zip = (change.kind == BSSFile::Change::Kind::Delete)
+                                  ? change.zipCode : change.record.getZipCode();
+            file.deleteRecord(zip);
+            if (change.kind == BSSFile::Change::Kind::Upsert && !file.addRecord(change.record)) {
+                result.ok = false;
+            }
+        }
+    }
+    result.ok = file.sync() && result.ok;
+    auto stop = std::chrono::steady_clock::now();
+
+    result.seconds = std::chrono::duration<double>(stop - start).count();
+    result.blockWrites = file.getCacheStats().writeBacks;
+    file.close();
+    return result;
+}
+
+// The istringstream tokenizer ZipCodeRecordBuffer::unpack used before it split string_views, kept here as the baseline
+bool legacyUnpack(const std::string& line, ZipCodeRecordBuffer& out) {
+    auto trim = [](std::string& s) {
+        s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) { return !std::isspace(ch); }));
+        s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char ch) { return !std::isspace(ch); }).base(), s.end());
+    };
+    std::istringstream ss(line);
+    std::vector<std::string> fields;
+    std::string token;
+    while (std::getline(ss, token, ',')) {
+        trim(token);
+        if (token.size() >= 2 && token.front() == '"' && token.back() == '"') {
+            token = token.substr(1, token.size() - 2);
+            trim(token);
+        }
+        fields.push_back(token);
+    }
+    if (fields.size() < 6) return false;
+
+    double lat, lon;
+    try {
+        lat = std::stod(fields[4]);
+        lon = std::stod(fields[5]);
+    } catch (const std::exception&) {
+        return false;
+    }
+    std::string_view text[4] = {fields[0], fields[1], fields[2], fields[3]};
+    out.assign(text, lat, lon);
+    return true;
+}
+
+bool sameRecord(const ZipCodeRecordBuffer& a, const ZipCodeRecordBuffer& b) {
+    auto sameNumber = [](double x, double y) { return x == y || (std::isnan(x) && std::isnan(y)); };
+    return a.getZipCode() == b.getZipCode() && a.getPlaceName() == b.getPlaceName() &&
+           a.getState() == b.getState() && a.getCounty() == b.getCounty() &&
+           sameNumber(a.getLatitude(), b.getLatitude()) && sameNumber(a.getLongitude(), b.getLongitude());
+}
+
+} // namespace
+
+void benchmarkLookups(const std::string& bssFile, size_t lookupCount) {
+    std::cout << "\n=== Lookup Benchmark: fstream vs. mmap ===\n";
+
+    std::vector<std::string> keys = collectKeys(bssFile);
+    if (keys.empty()) {
+        std::cerr << "Error: Could not read any keys from '" << bssFile << "'.\n";
+        return;
+    }
+
+    // Fixed seed so runs are comparable
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+    std::vector<std::string> probes;
+    probes.reserve(lookupCount);
+    for (size_t i = 0; i < lookupCount; ++i) {
+        probes.push_back(keys[pick(rng)]);
+    }
+
+    std::cout << "File: " << bssFile << " (" << keys.size() << " records)\n";
+    std::cout << "Lookups per mode: " << lookupCount << " random existing keys\n\n";
+
+    // Untimed pass so both modes start with the file in the OS page cache
+    timeLookups(bssFile, BSSFile::OpenMode::ReadWrite, probes);
+
+    LookupResult viaStream = timeLookups(bssFile, BSSFile::OpenMode::ReadWrite, probes);
+    LookupResult viaMapping = timeLookups(bssFile, BSSFile::OpenMode::MappedReadOnly, probes);
+    if (!viaStream.ok || !viaMapping.ok) {
+        std::cerr << "Error: Could not open '" << bssFile << "' for benchmarking.\n";
+        return;
+    }
+
+    LookupResult batched = timeBatch(bssFile, BSSFile::OpenMode::ReadWrite, probes);
+
+    printResult("fstream + cache (64, LRU)", viaStream, lookupCount);
+    printResult("mmap read-only", viaMapping, lookupCount);
+    printResult("lookupBatch (fstream)", batched, lookupCount);
+    std::cout << "Block reads from disk (fstream): one at a time " << viaStream.cacheStats.misses
+              << ", batched " << batched.cacheStats.misses << "\n";
+    std::cout << "Block cache hit ratio (fstream): " << std::fixed << std::setprecision(1)
+              << viaStream.cacheStats.hitRatio() * 100.0 << "%\n";
+    if (viaMapping.seconds > 0) {
+        std::cout << "Speedup (mmap over fstream): " << std::setprecision(2)
+                  << viaStream.seconds / viaMapping.seconds << "x\n";
+    }
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << std::setprecision(6);
+}
+
+void benchmarkCreate(const std::string& datFile, unsigned replicas, unsigned maxThreads) {
+    std::cout << "\n=== Create Benchmark: threads ===\n";
+
+    std::string input = datFile;
+    if (replicas > 1) {
+        input = datFile + ".x" + std::to_string(replicas);
+        if (!replicateDatFile(datFile, input, replicas)) {
+            std::cerr << "Error: Could not replicate '" << datFile << "'.\n";
+            return;
+        }
+    }
+    std::cout << "Input: " << datFile << " x" << replicas << "\n\n";
+    std::cout << "threads    seconds  speedup  identical\n";
+
+    std::string reference = input + ".t1.bss";
+    std::vector<char> referenceBytes;
+    double serialSeconds = 0.0;
+
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        std::string output = input + ".t" + std::to_string(threads) + ".bss";
+        BSSCreateOptions options;
+        options.threads = threads;
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok;
+        {
+            QuietCout quiet;
+            BSSFile file;
+            ok = file.create(output, input, options);
+        }
+        auto stop = std::chrono::steady_clock::now();
+        if (!ok) {
+            std::cerr << "Error: create failed with " << threads << " thread(s).\n";
+            break;
+        }
+
+        double seconds = std::chrono::duration<double>(stop - start).count();
+        bool identical = true;
+        if (threads == 1) {
+            serialSeconds = seconds;
+            referenceBytes = readWholeFile(output);
+        } else {
+            identical = (readWholeFile(output) == referenceBytes);
+            std::remove(output.c_str());
+        }
+        std::remove((output + ".idx").c_str());  // Written by create alongside the file
+
+        std::cout << std::setw(7) << threads << std::fixed << std::setprecision(3)
+                  << std::setw(11) << seconds << std::setprecision(2)
+                  << std::setw(8) << (seconds > 0 ? serialSeconds / seconds : 0.0) << "x"
+                  << std::setw(11) << (identical ? "yes" : "NO") << "\n";
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+    }
+
+    std::remove(reference.c_str());
+    if (input != datFile) std::remove(input.c_str());
+}
+
+void benchmarkConvert(const std::string& csvFile, unsigned replicas, unsigned maxThreads) {
+    std::cout << "\n=== CSV Conversion Benchmark: threads ===\n";
+
+    std::string input = csvFile;
+    if (replicas > 1) {
+        input = csvFile + ".x" + std::to_string(replicas);
+        if (!replicateCsvFile(csvFile, input, replicas)) {
+            std::cerr << "Error: Could not replicate '" << csvFile << "'.\n";
+            return;
+        }
+    }
+    double inputMB = (double)fileSize(input) / (1024.0 * 1024.0);
+    std::cout << "Input: " << csvFile << " x" << replicas << " (" << std::fixed << std::setprecision(1)
+              << inputMB << " MB)\n\n";
+    std::cout.unsetf(std::ios::fixed);
+    std::cout << "threads    seconds     MB/s  speedup  identical\n";
+
+    // The .dat headers carry the creation time, so only the records and the index are compared
+    auto recordBytes = [](const std::string& datFile) {
+        std::vector<char> bytes = readWholeFile(datFile);
+        uint32_t headerSize = 0;
+        if (bytes.size() >= sizeof(headerSize)) std::memcpy(&headerSize, bytes.data(), sizeof(headerSize));
+        size_t skip = std::min(bytes.size(), sizeof(headerSize) + (size_t)headerSize);
+        bytes.erase(bytes.begin(), bytes.begin() + skip);
+        return bytes;
+    };
+
+    std::vector<char> referenceRecords, referenceIndex;
+    double serialSeconds = 0.0;
+
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        // Fixed-width names: processFile stores the index path in the .dat header, and a
+        // longer header would shift every offset in the index
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), ".t%04u.dat", threads);
+        std::string output = input + suffix;
+        std::string indexFile = output + ".idx";
+
+        auto start = std::chrono::steady_clock::now();
+        {
+            QuietCout quiet;
+            processFile(input, output, threads, indexFile);
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(stop - start).count();
+        bool identical = true;
+        if (threads == 1) {
+            serialSeconds = seconds;
+            referenceRecords = recordBytes(output);
+            referenceIndex = readWholeFile(indexFile);
+        } else {
+            identical = (recordBytes(output) == referenceRecords && readWholeFile(indexFile) == referenceIndex);
+        }
+        std::remove(output.c_str());
+        std::remove(indexFile.c_str());
+
+        std::cout << std::setw(7) << threads << std::fixed << std::setprecision(3)
+                  << std::setw(11) << seconds << std::setprecision(1)
+                  << std::setw(9) << (seconds > 0 ? inputMB / seconds : 0.0) << std::setprecision(2)
+                  << std::setw(8) << (seconds > 0 ? serialSeconds / seconds : 0.0) << "x"
+                  << std::setw(11) << (identical ? "yes" : "NO") << "\n";
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+    }
+
+    if (input != csvFile) std::remove(input.c_str());
+}
+
+void benchmarkBlockLayout(const std::string& datFile, size_t lookupCount, size_t insertCount) {
+    std::cout << "\n=== Block Layout Benchmark: block size x fill factor ===\n";
+
+    const uint32_t blockSizes[] = {512, 1024, 4096, 8192};
+    const double fillFactors[] = {1.0, 0.85, 0.7};
+    std::string scratch = datFile + ".layout.bss";
+
+    std::vector<std::string> keys;
+    std::vector<std::string> probes;
+    std::vector<ZipCodeRecordBuffer> inserts;
+
+    std::cout << "Input: " << datFile << ", " << lookupCount << " random lookups (fstream + 64-frame cache), "
+              << insertCount << " inserts of new keys per configuration\n\n";
+    std::cout << " block  fill   file KiB   blocks  lookup ns  insert us   splits\n";
+
+    for (uint32_t size : blockSizes) {
+        for (double fill : fillFactors) {
+            BSSCreateOptions options;
+            options.threads = 0;
+            options.blockSize = size;
+            options.fillFactor = fill;
+            {
+                QuietCout quiet;
+                BSSFile file;
+                if (!file.create(scratch, datFile, options)) {
+                    std::cerr << "Error: create failed for block size " << size << "\n";
+                    return;
+                }
+            }
+
+            // The key set is the same for every layout; sample it once
+            if (keys.empty()) {
+                keys = collectKeys(scratch);
+                if (keys.empty()) return;
+                std::mt19937 rng(42);
+                std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+                for (size_t i = 0; i < lookupCount; ++i) probes.push_back(keys[pick(rng)]);
+                inserts = makeInsertRecords(keys, insertCount);
+            }
+
+            size_t bytes = fileSize(scratch);
+            LookupResult lookups = timeLookups(scratch, BSSFile::OpenMode::ReadWrite, probes);
+
+            uint32_t blocksBefore = 0;
+            uint32_t blocksAfter = 0;
+            double insertSeconds = 0.0;
+            {
+                QuietCout quiet;
+                BSSFile file;
+                if (!file.open(scratch)) return;
+                file.getIndex(); // Index build is not part of the insert cost
+                blocksBefore = file.getHeader().getBlockCount();
+                auto start = std::chrono::steady_clock::now();
+                for (const auto& rec : inserts) {
+                    file.addRecord(rec);
+                }
+                file.flush();
+                auto stop = std::chrono::steady_clock::now();
+                insertSeconds = std::chrono::duration<double>(stop - start).count();
+                blocksAfter = file.getHeader().getBlockCount();
+                file.close();
+            }
+
+            std::cout << std::setw(6) << size << std::fixed << std::setprecision(2)
+                      << std::setw(6) << fill << std::setprecision(0)
+                      << std::setw(11) << bytes / 1024.0
+                      << std::setw(9) << blocksBefore
+                      << std::setw(11) << (lookupCount ? lookups.seconds * 1e9 / lookupCount : 0.0)
+                      << std::setprecision(1)
+                      << std::setw(11) << (inserts.empty() ? 0.0 : insertSeconds * 1e6 / inserts.size())
+                      << std::setw(9) << (blocksAfter - blocksBefore) << "\n";
+            std::cout.unsetf(std::ios::fixed);
+            std::cout << std::setprecision(6);
+        }
+    }
+    std::remove(scratch.c_str());
+    std::remove((scratch + ".idx").c_str());
+}
+
+void benchmarkIndex(size_t maxEntries, size_t lookupCount) {
+    std::cout << "\n=== Index Benchmark: std::map vs. flat array findRBN ===\n";
+    std::cout << lookupCount << " random keys per size (hits and misses)\n\n";
+    std::cout << "  entries    map ns   flat ns  speedup  agree\n";
+
+    std::mt19937_64 rng(42);
+    for (size_t entries = 1000; entries <= maxEntries; entries *= 10) {
+        // Keys at least 5 digits like ZIP codes, spread evenly over their range
+        int width = 5;
+        uint64_t range = 100000;
+        while (range < entries * 10) {
+            range *= 10;
+            width++;
+        }
+        uint64_t step = range / entries;
+
+        std::map<std::string, int> tree;
+        BSSIndex flat;
+        for (size_t i = 0; i < entries; ++i) {
+            std::string key = makeIndexKey((i + 1) * step - 1, width);
+            tree[key] = (int)i;
+            flat.setEntry(key, (int)i);
+        }
+
+        std::uniform_int_distribution<uint64_t> pick(0, range - 1);
+        std::vector<std::string> probes;
+        probes.reserve(lookupCount);
+        for (size_t i = 0; i < lookupCount; ++i) {
+            probes.push_back(makeIndexKey(pick(rng), width));
+        }
+
+        long long treeSum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& key : probes) treeSum += mapFindRBN(tree, key);
+        auto mid = std::chrono::steady_clock::now();
+        long long flatSum = 0;
+        for (const auto& key : probes) flatSum += flat.findRBN(key);
+        auto stop = std::chrono::steady_clock::now();
+
+        double treeNs = std::chrono::duration<double, std::nano>(mid - start).count() / lookupCount;
+        double flatNs = std::chrono::duration<double, std::nano>(stop - mid).count() / lookupCount;
+        std::cout << std::setw(9) << entries << std::fixed << std::setprecision(1)
+                  << std::setw(10) << treeNs << std::setw(10) << flatNs
+                  << std::setprecision(2) << std::setw(8) << (flatNs > 0 ? treeNs / flatNs : 0.0) << "x"
+                  << std::setw(7) << (treeSum == flatSum ? "yes" : "NO") << "\n";
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+    }
+}
+
+void benchmarkApplyChanges(const std::string& bssFile, size_t maxChanges) {
+    std::cout << "\n=== Change Set Benchmark: addRecord/deleteRecord vs. applyChanges ===\n";
+
+    std::vector<std::string> keys = collectKeys(bssFile);
+    if (keys.empty()) {
+        std::cerr << "Error: Could not read any keys from '" << bssFile << "'.\n";
+        return;
+    }
+    std::string perRecordFile = bssFile + ".apply1.bss";
+    std::string batchedFile = bssFile + ".apply2.bss";
+
+    std::cout << "File: " << bssFile << " (" << keys.size() << " records); "
+              << "changes are 40% new keys, 30% replacements, 30% deletes\n\n";
+    std::cout << "  changes  per-record/s   applyChanges/s  speedup  block writes (per-record/batched)  same\n";
+
+    for (size_t count = 100; count <= maxChanges; count *= 10) {
+        std::vector<BSSFile::Change> changes = makeChangeSet(keys, count);
+        ApplyResult perRecord = timeApply(bssFile, perRecordFile, changes, false);
+        ApplyResult batched = timeApply(bssFile, batchedFile, changes, true);
+        if (!perRecord.ok || !batched.ok) {
+            std::cerr << "Error: Applying " << count << " changes failed.\n";
+            break;
+        }
+        // Version 1 blocks keep insertion order, so compare the key sets rather than chain order.
+        // Keys the source file already holds more than once are removed one copy per
+        // deleteRecord but all at once by applyChanges, so duplicates are not counted.
+        std::vector<std::string> perRecordKeys = collectKeys(perRecordFile);
+        std::vector<std::string> batchedKeys = collectKeys(batchedFile);
+        bool same = std::set<std::string>(perRecordKeys.begin(), perRecordKeys.end()) ==
+                    std::set<std::string>(batchedKeys.begin(), batchedKeys.end());
+
+        std::cout << std::setw(9) << count << std::fixed << std::setprecision(0)
+                  << std::setw(14) << (perRecord.seconds > 0 ? count / perRecord.seconds : 0.0)
+                  << std::setw(17) << (batched.seconds > 0 ? count / batched.seconds : 0.0)
+                  << std::setprecision(2)
+                  << std::setw(8) << (batched.seconds > 0 ? perRecord.seconds / batched.seconds : 0.0) << "x"
+                  << std::setw(18) << perRecord.blockWrites << " / " << std::left << std::setw(16)
+                  << batched.blockWrites << std::right << std::setw(5) << (same ? "yes" : "NO") << "\n";
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+    }
+    std::remove(perRecordFile.c_str());
+    std::remove(batchedFile.c_str());
+}
+
+void benchmarkParsing(const std::vector<std::string>& csvFiles, unsigned passes) {
+    std::cout << "\n=== Parsing Benchmark: istringstream + stod vs. string_view + from_chars ===\n";
+    std::cout << passes << " passes over every line of each file\n\n";
+    std::cout << "  file                          lines  records   old ns   new ns  old MB/s  new MB/s  speedup  agree\n";
+
+    for (const std::string& csvFile : csvFiles) {
+        std::ifstream in(csvFile, std::ios::binary);
+        if (!in) {
+            std::cout << "  " << csvFile << ": cannot open\n";
+            continue;
+        }
+        std::vector<std::string> lines;
+        size_t bytes = 0;
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            bytes += line.size();
+            lines.push_back(line);
+        }
+
+        // Both parsers must accept the same lines and produce the same records
+        ZipCodeRecordBuffer oldRec, newRec;
+        size_t records = 0;
+        bool agree = true;
+        for (const auto& text : lines) {
+            bool oldOk = legacyUnpack(text, oldRec);
+            bool newOk = newRec.unpack(text);
+            if (oldOk != newOk || (oldOk && !sameRecord(oldRec, newRec))) agree = false;
+            if (newOk) records++;
+        }
+
+        size_t oldParsed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned pass = 0; pass < passes; ++pass) {
+            for (const auto& text : lines) oldParsed += legacyUnpack(text, oldRec);
+        }
+        auto mid = std::chrono::steady_clock::now();
+        size_t newParsed = 0;
+        for (unsigned pass = 0; pass < passes; ++pass) {
+            for (const auto& text : lines) newParsed += newRec.unpack(text);
+        }
+        auto stop = std::chrono::steady_clock::now();
+
+        double oldSeconds = std::chrono::duration<double>(mid - start).count();
+        double newSeconds = std::chrono::duration<double>(stop - mid).count();
+        double totalLines = (double)lines.size() * passes;
+        double totalMB = (double)bytes * passes / (1024.0 * 1024.0);
+        std::string name = csvFile.size() > 28 ? "..." + csvFile.substr(csvFile.size() - 25) : csvFile;
+        std::cout << "  " << std::left << std::setw(28) << name << std::right
+                  << std::setw(7) << lines.size() << std::setw(9) << records
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(9) << (oldSeconds * 1e9 / totalLines) << std::setw(9) << (newSeconds * 1e9 / totalLines)
+                  << std::setw(10) << (oldSeconds > 0 ? totalMB / oldSeconds : 0.0)
+                  << std::setw(10) << (newSeconds > 0 ? totalMB / newSeconds : 0.0)
+                  << std::setprecision(2) << std::setw(8) << (newSeconds > 0 ? oldSeconds / newSeconds : 0.0) << "x"
+                  << std::setw(7) << (agree && oldParsed == newParsed ? "yes" : "NO") << "\n";
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6);
+    }
+}
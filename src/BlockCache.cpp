@@ -0,0 +1,198 @@
+#include "../headers/BlockCache.h"
+#include "../headers/Log.h"
+#include <algorithm>
+
+// --- LRUPolicy ---
+
+void LRUPolicy::reset(size_t frameCount) {
+    order.clear();
+    position.assign(frameCount, order.end());
+    tracked.assign(frameCount, false);
+}
+
+void LRUPolicy::recordAccess(size_t frame) {
+    if (tracked[frame]) {
+        order.erase(position[frame]);
+    }
+    order.push_front(frame);
+    position[frame] = order.begin();
+    tracked[frame] = true;
+}
+
+long LRUPolicy::chooseVictim(const std::function<bool(size_t)>& isEvictable) {
+    // Walk from the least recently used end
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        if (isEvictable(*it)) {
+            return static_cast<long>(*it);
+        }
+    }
+    return -1;
+}
+
+// --- ClockPolicy ---
+
+void ClockPolicy::reset(size_t frameCount) {
+    referenced.assign(frameCount, false);
+    hand = 0;
+}
+
+void ClockPolicy::recordAccess(size_t frame) {
+    referenced[frame] = true;
+}
+
+long ClockPolicy::chooseVictim(const std::function<bool(size_t)>& isEvictable) {
+    if (referenced.empty()) return -1;
+
+    // Two sweeps are enough: the first clears reference bits, the second finds a victim
+    for (size_t step = 0; step < 2 * referenced.size(); ++step) {
+        size_t frame = hand;
+        hand = (hand + 1) % referenced.size();
+        if (!isEvictable(frame)) continue;
+        if (referenced[frame]) {
+            referenced[frame] = false;
+            continue;
+        }
+        return static_cast<long>(frame);
+    }
+    return -1;
+}
+
+// --- BlockCache ---
+
+BlockCache::BlockCache(size_t capacity, Policy policy)
+    : policyKind(policy), file(nullptr), blockSize(0) {
+    configure(capacity, policy);
+}
+
+void BlockCache::configure(size_t capacity, Policy policyType) {
+    flush();
+    if (capacity == 0) capacity = 1;
+
+    policyKind = policyType;
+    if (policyKind == Policy::CLOCK) {
+        policy.reset(new ClockPolicy());
+    } else {
+        policy.reset(new LRUPolicy());
+    }
+
+    frames.assign(capacity, Frame());
+    attach(file, blockSize);
+}
+
+void BlockCache::attach(std::fstream* f, uint32_t bSize) {
+    file = f;
+    blockSize = bSize;
+    frameTable.clear();
+    freeFrames.clear();
+    for (size_t i = frames.size(); i-- > 0;) {
+        frames[i].rbn = -1;
+        frames[i].pinCount = 0;
+        frames[i].dirty = false;
+        frames[i].data.assign(blockSize, 0);
+        freeFrames.push_back(i);
+    }
+    policy->reset(frames.size());
+}
+
+void BlockCache::detach() {
+    attach(nullptr, 0);
+}
+
+char* BlockCache::pin(int rbn, bool loadFromDisk) {
+    if (!file || rbn < 0) return nullptr;
+
+    auto it = frameTable.find(rbn);
+    if (it != frameTable.end()) {
+        Frame& frame = frames[it->second];
+        frame.pinCount++;
+        policy->recordAccess(it->second);
+        stats.hits++;
+        return frame.data.data();
+    }
+
+    stats.misses++;
+    long slot = findFrameForLoad();
+    if (slot < 0) return nullptr;
+
+    Frame& frame = frames[slot];
+    if (loadFromDisk) {
+        file->seekg((long long)rbn * blockSize, std::ios::beg);
+        file->read(frame.data.data(), blockSize);
+        if (!file->good()) {
+            file->clear();
+            freeFrames.push_back(static_cast<size_t>(slot));
+            return nullptr;
+        }
+    }
+
+    frame.rbn = rbn;
+    frame.pinCount = 1;
+    frame.dirty = false;
+    frameTable[rbn] = static_cast<size_t>(slot);
+    policy->recordAccess(static_cast<size_t>(slot));
+    return frame.data.data();
+}
+
+void BlockCache::unpin(int rbn, bool dirty) {
+    auto it = frameTable.find(rbn);
+    if (it == frameTable.end()) return;
+
+    Frame& frame = frames[it->second];
+    if (frame.pinCount > 0) frame.pinCount--;
+    if (dirty) frame.dirty = true;
+}
+
+bool BlockCache::flush() {
+    bool ok = true;
+    for (auto& frame : frames) {
+        if (frame.rbn != -1 && frame.dirty) {
+            ok = writeBack(frame) && ok;
+        }
+    }
+    if (file && file->is_open()) file->flush();
+    return ok;
+}
+
+bool BlockCache::writeBack(Frame& frame) {
+    if (!file) return false;
+    if (writeBackGuard && !writeBackGuard(frame.rbn)) {
+        LOG_ERROR("BlockCache", "Write-back of RBN " << frame.rbn << " refused by the write-back guard");
+        return false;
+    }
+    file->seekp((long long)frame.rbn * blockSize, std::ios::beg);
+    file->write(frame.data.data(), blockSize);
+    if (!file->good()) {
+        file->clear();
+        LOG_ERROR("BlockCache", "Write-back of RBN " << frame.rbn << " failed");
+        return false;
+    }
+    frame.dirty = false;
+    stats.writeBacks++;
+    return true;
+}
+
+long BlockCache::findFrameForLoad() {
+    if (!freeFrames.empty()) {
+        size_t slot = freeFrames.back();
+        freeFrames.pop_back();
+        return static_cast<long>(slot);
+    }
+
+    long victim = policy->chooseVictim([this](size_t i) {
+        return frames[i].pinCount == 0;
+    });
+    if (victim < 0) {
+        LOG_ERROR("BlockCache", "All " << frames.size() << " frames are pinned");
+        return -1;
+    }
+
+    // writeBack() reports its own failure; the victim stays cached and dirty
+    Frame& frame = frames[victim];
+    if (frame.dirty && !writeBack(frame)) {
+        return -1;
+    }
+    frameTable.erase(frame.rbn);
+    frame.rbn = -1;
+    stats.evictions++;
+    return victim;
+}
@@ -0,0 +1,243 @@
+#include "../headers/ExternalSorter.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+
+// Smallest read buffer worth giving a run during a merge
+const size_t MIN_READ_BUFFER = 64 * 1024;
+const size_t MAX_FAN_IN = 64;
+
+bool keyLess(const ZipCodeRecordBuffer& a, const ZipCodeRecordBuffer& b) {
+    return a.getZipKey() < b.getZipKey();
+}
+
+// std heap functions keep the largest on top, so this orders by descending
+// key: the smallest key surfaces first, and the earlier run wins ties
+struct HeapOrder {
+    template <typename Entry>
+    bool operator()(const Entry& a, const Entry& b) const {
+        ZipKey keyA = a.record.getZipKey();
+        ZipKey keyB = b.record.getZipKey();
+        if (keyA != keyB) return keyA > keyB;
+        return a.run > b.run;
+    }
+};
+
+} // namespace
+
+ExternalSorter::ExternalSorter(size_t budget, const std::string& prefix)
+    : memoryBudget(budget), fanIn(2), tempPrefix(prefix), pendingBytes(0),
+      nextRunId(0), runsSpilled(0), memoryCursor(0), finished(false),
+      recordCount(0), peakBytes(0) {
+    fanIn = std::min(MAX_FAN_IN, std::max<size_t>(2, memoryBudget / MIN_READ_BUFFER));
+
+    // Reserve the run up front so vector growth cannot jump past the budget
+    size_t runLimit = memoryBudget / 2;
+    pending.reserve(std::max<size_t>(1, runLimit / (sizeof(ZipCodeRecordBuffer) + 32)));
+}
+
+ExternalSorter::~ExternalSorter() {
+    readers.clear();
+    for (const auto& run : runs) {
+        std::remove(run.c_str());
+    }
+}
+
+size_t ExternalSorter::estimateBytes(const ZipCodeRecordBuffer& record) {
+    // Only place and county names are long enough to leave the small-string buffer
+    size_t place = record.getPlaceName().size();
+    size_t county = record.getCounty().size();
+    return (place > 15 ? place + 1 : 0) + (county > 15 ? county + 1 : 0);
+}
+
+std::string ExternalSorter::runName(size_t id) const {
+    return tempPrefix + ".run" + std::to_string(id) + ".tmp";
+}
+
+size_t ExternalSorter::readBufferBytes(size_t runCount) const {
+    // Half the budget for read buffers, the rest for the heap and the consumer
+    return std::max<size_t>(4096, memoryBudget / (2 * std::max<size_t>(1, runCount)));
+}
+
+bool ExternalSorter::add(const ZipCodeRecordBuffer& record) {
+    if (finished) return false;
+
+    // Half the budget is kept free for the stable sort's scratch buffer
+    size_t held = pending.capacity() * sizeof(ZipCodeRecordBuffer) + pendingBytes;
+    if (!pending.empty() && (pending.size() == pending.capacity() || held > memoryBudget / 2)) {
+        if (!spill()) return false;
+    }
+
+    pending.push_back(record);
+    pendingBytes += estimateBytes(record);
+    recordCount++;
+    held = pending.capacity() * sizeof(ZipCodeRecordBuffer) + pendingBytes;
+    peakBytes = std::max(peakBytes, held);
+    return true;
+}
+
+bool ExternalSorter::spill() {
+    std::stable_sort(pending.begin(), pending.end(), keyLess);
+
+    std::string name = runName(nextRunId++);
+    std::ofstream out(name, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "[ExternalSorter] Error: could not create run file " << name << "\n";
+        return false;
+    }
+    for (const auto& record : pending) {
+        std::string packed = record.pack(RUN_ENCODING);
+        uint32_t length = (uint32_t)packed.size();
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(packed.data(), length);
+    }
+    if (!out.good()) {
+        std::cerr << "[ExternalSorter] Error: could not write run file " << name << "\n";
+        return false;
+    }
+
+    runs.push_back(name);
+    runsSpilled++;
+    pending.clear();
+    pendingBytes = 0;
+    return true;
+}
+
+bool ExternalSorter::finish() {
+    if (finished) return true;
+    finished = true;
+
+    if (runs.empty()) {
+        // Everything fit: sort in memory and serve from the vector
+        std::stable_sort(pending.begin(), pending.end(), keyLess);
+        memoryCursor = 0;
+        return true;
+    }
+
+    if (!pending.empty() && !spill()) return false;
+    std::vector<ZipCodeRecordBuffer>().swap(pending);
+
+    // Intermediate passes: merge neighbouring groups until one final merge is enough
+    while (runs.size() > fanIn) {
+        std::vector<std::string> merged;
+        for (size_t first = 0; first < runs.size(); first += fanIn) {
+            size_t last = std::min(runs.size(), first + fanIn);
+            if (last - first == 1) {
+                merged.push_back(runs[first]);
+                continue;
+            }
+            std::string name = runName(nextRunId++);
+            if (!mergeRuns(first, last, name)) {
+                // The destructor removes everything in runs: hand it this pass's
+                // outputs too, including the partially written target
+                runs.insert(runs.end(), merged.begin(), merged.end());
+                runs.push_back(name);
+                return false;
+            }
+            merged.push_back(name);
+        }
+        runs = merged;
+    }
+
+    return openMerge(0, runs.size());
+}
+
+bool ExternalSorter::next(ZipCodeRecordBuffer& out) {
+    if (!finished) return false;
+
+    if (runs.empty()) {
+        if (memoryCursor >= pending.size()) return false;
+        out = std::move(pending[memoryCursor++]);
+        return true;
+    }
+
+    if (popMerged(out)) return true;
+
+    // Merge exhausted: the run files are no longer needed
+    readers.clear();
+    for (const auto& run : runs) {
+        std::remove(run.c_str());
+    }
+    runs.clear();
+    pending.clear();
+    memoryCursor = 0;
+    return false;
+}
+
+bool ExternalSorter::mergeRuns(size_t first, size_t last, const std::string& target) {
+    if (!openMerge(first, last)) return false;
+
+    std::ofstream out(target, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "[ExternalSorter] Error: could not create run file " << target << "\n";
+        return false;
+    }
+    ZipCodeRecordBuffer record;
+    while (popMerged(record)) {
+        std::string packed = record.pack(RUN_ENCODING);
+        uint32_t length = (uint32_t)packed.size();
+        out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        out.write(packed.data(), length);
+    }
+    readers.clear();
+    for (size_t i = first; i < last; ++i) {
+        std::remove(runs[i].c_str());
+    }
+    return out.good();
+}
+
+bool ExternalSorter::openMerge(size_t first, size_t last) {
+    readers.clear();
+    heap.clear();
+    size_t bufferBytes = readBufferBytes(last - first);
+
+    for (size_t i = first; i < last; ++i) {
+        std::unique_ptr<RunReader> reader(new RunReader());
+        reader->buffer.resize(bufferBytes);
+        reader->in.rdbuf()->pubsetbuf(reader->buffer.data(), reader->buffer.size());
+        reader->in.open(runs[i], std::ios::binary);
+        if (!reader->in) {
+            std::cerr << "[ExternalSorter] Error: could not open run file " << runs[i] << "\n";
+            return false;
+        }
+
+        HeapEntry entry;
+        entry.run = i - first;
+        if (reader->read(entry.record)) {
+            heap.push_back(std::move(entry));
+        }
+        readers.push_back(std::move(reader));
+    }
+    std::make_heap(heap.begin(), heap.end(), HeapOrder());
+
+    peakBytes = std::max(peakBytes, bufferBytes * (last - first)
+                                    + heap.size() * sizeof(HeapEntry));
+    return true;
+}
+
+bool ExternalSorter::popMerged(ZipCodeRecordBuffer& out) {
+    if (heap.empty()) return false;
+
+    std::pop_heap(heap.begin(), heap.end(), HeapOrder());
+    HeapEntry& top = heap.back();
+    out = std::move(top.record);
+    if (readers[top.run]->read(top.record)) {
+        std::push_heap(heap.begin(), heap.end(), HeapOrder());
+    } else {
+        heap.pop_back();
+    }
+    return true;
+}
+
+bool ExternalSorter::RunReader::read(ZipCodeRecordBuffer& out) {
+    uint32_t length;
+    std::string packed;
+    while (in.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+        packed.resize(length);
+        if (!in.read(&packed[0], length)) return false;
+        if (out.unpack(packed, RUN_ENCODING)) return true;
+    }
+    return false;
+}
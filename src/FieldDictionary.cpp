@@ -0,0 +1,153 @@
+#include "../headers/FieldDictionary.h"
+#include "../headers/IndexFile.h"
+#include "../headers/Log.h"
+#include <cstring>
+
+static_assert(sizeof(DictionaryImageHeader) == 24, "DictionaryImageHeader is written raw and must not change size");
+
+const uint32_t FieldDictionary::MAX_CODES[2] = {256, 65536};
+
+namespace {
+
+const char DICTIONARY_MAGIC[4] = {'B', 'D', 'I', 'C'};
+
+// State code, county code, latitude, longitude
+const size_t CODED_TAIL_BYTES = sizeof(uint8_t) + sizeof(uint16_t) + 2 * sizeof(int32_t);
+
+} // namespace
+
+FieldDictionary::FieldDictionary() {
+    clear();
+}
+
+void FieldDictionary::clear() {
+    for (int column = 0; column < 2; ++column) {
+        values[column].clear();
+        codes[column].clear();
+    }
+    image.assign(sizeof(DictionaryImageHeader), 0);
+    savedBytes = image.size();
+}
+
+bool FieldDictionary::encode(Column column, std::string_view value, uint32_t& code) {
+    std::string key(value);
+    auto it = codes[column].find(key);
+    if (it != codes[column].end()) {
+        code = it->second;
+        return true;
+    }
+    if (values[column].size() >= MAX_CODES[column]) {
+        LOG_ERROR("DICT", "No " << (column == STATE ? "State" : "County") << " code left for '" << key << "'");
+        return false;
+    }
+
+    code = (uint32_t)values[column].size();
+    image.push_back(static_cast<char>(column));
+    image.push_back(static_cast<char>(key.size()));  // Fields are at most 50 bytes
+    image.insert(image.end(), key.begin(), key.end());
+    codes[column].emplace(key, code);
+    values[column].push_back(std::move(key));
+    return true;
+}
+
+long FieldDictionary::find(Column column, std::string_view value) const {
+    auto it = codes[column].find(std::string(value));
+    return it == codes[column].end() ? -1 : (long)it->second;
+}
+
+bool FieldDictionary::pack(const ZipCodeRecordBuffer& record, std::string& out) {
+    uint32_t stateCode, countyCode;
+    if (!encode(STATE, record.getState(), stateCode) || !encode(COUNTY, record.getCounty(), countyCode)) {
+        return false;
+    }
+
+    // Zip, place and coordinates exactly as BinaryFixed writes them
+    std::string fixed = record.pack(RecordEncoding::BinaryFixed);
+    size_t placeEnd = ZIP_CODE_LENGTH + 1 + record.getPlaceName().size();
+    out.assign(fixed, 0, placeEnd);
+    uint8_t state = (uint8_t)stateCode;
+    uint16_t county = (uint16_t)countyCode;
+    out.append(reinterpret_cast<const char*>(&state), sizeof(state));
+    out.append(reinterpret_cast<const char*>(&county), sizeof(county));
+    out.append(fixed, fixed.size() - 2 * sizeof(int32_t), 2 * sizeof(int32_t));
+    return true;
+}
+
+bool FieldDictionary::decode(std::string_view packed, std::string_view text[2],
+                             uint32_t& stateCode, uint32_t& countyCode, double& lat, double& lon) {
+    if (packed.size() < ZIP_CODE_LENGTH + 1) return false;
+    text[0] = packed.substr(0, strnlen(packed.data(), ZIP_CODE_LENGTH));
+    size_t length = static_cast<unsigned char>(packed[ZIP_CODE_LENGTH]);
+    size_t pos = ZIP_CODE_LENGTH + 1;
+    if (pos + length + CODED_TAIL_BYTES != packed.size()) return false;
+    text[1] = packed.substr(pos, length);
+    pos += length;
+
+    uint8_t state;
+    uint16_t county;
+    int32_t fixed[2];
+    std::memcpy(&state, packed.data() + pos, sizeof(state));
+    std::memcpy(&county, packed.data() + pos + sizeof(state), sizeof(county));
+    std::memcpy(fixed, packed.data() + pos + sizeof(state) + sizeof(county), sizeof(fixed));
+    stateCode = state;
+    countyCode = county;
+    lat = fixed[0] == INT32_MIN ? std::numeric_limits<double>::quiet_NaN() : fixed[0] / COORDINATE_SCALE;
+    lon = fixed[1] == INT32_MIN ? std::numeric_limits<double>::quiet_NaN() : fixed[1] / COORDINATE_SCALE;
+    return true;
+}
+
+const std::vector<char>& FieldDictionary::getImage() {
+    DictionaryImageHeader header;
+    std::memcpy(header.magic, DICTIONARY_MAGIC, sizeof(header.magic));
+    header.entryCount = (uint32_t)(values[STATE].size() + values[COUNTY].size());
+    header.payloadBytes = image.size() - sizeof(header);
+    header.checksum = IndexFile::checksum(image.data() + sizeof(header), (size_t)header.payloadBytes);
+    std::memcpy(image.data(), &header, sizeof(header));
+    return image;
+}
+
+bool FieldDictionary::load(const char* data, size_t length) {
+    clear();
+    DictionaryImageHeader header;
+    if (length < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, DICTIONARY_MAGIC, sizeof(header.magic)) != 0 ||
+        header.payloadBytes > length - sizeof(header) ||
+        IndexFile::checksum(data + sizeof(header), (size_t)header.payloadBytes) != header.checksum) {
+        LOG_ERROR("DICT", "Dictionary image is damaged");
+        return false;
+    }
+
+    const char* pos = data + sizeof(header);
+    const char* end = pos + header.payloadBytes;
+    for (uint32_t i = 0; i < header.entryCount; ++i) {
+        if (end - pos < 2) return false;
+        Column column = static_cast<Column>(pos[0]);
+        size_t valueLength = static_cast<unsigned char>(pos[1]);
+        if (column > COUNTY || (size_t)(end - pos - 2) < valueLength) return false;
+        uint32_t code;
+        if (!encode(column, std::string_view(pos + 2, valueLength), code)) return false;
+        pos += 2 + valueLength;
+    }
+    savedBytes = image.size();
+    return true;
+}
+
+FieldDictionary::Mark FieldDictionary::mark() const {
+    Mark restorePoint;
+    restorePoint.entries[STATE] = values[STATE].size();
+    restorePoint.entries[COUNTY] = values[COUNTY].size();
+    restorePoint.imageBytes = image.size();
+    return restorePoint;
+}
+
+void FieldDictionary::rollback(const Mark& restorePoint) {
+    for (int column = 0; column < 2; ++column) {
+        while (values[column].size() > restorePoint.entries[column]) {
+            codes[column].erase(values[column].back());
+            values[column].pop_back();
+        }
+    }
+    image.resize(restorePoint.imageBytes);
+    if (savedBytes > image.size()) savedBytes = image.size();
+}
@@ -0,0 +1,174 @@
+#include "../headers/IndexFile.h"
+#include "../headers/Log.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(IndexFileHeader) == 48, "IndexFileHeader is written raw and must not change size");
+
+IndexFile::IndexFile()
+    : base(nullptr), length(0), keyData(nullptr), valueData(nullptr) {
+    std::memset(&header, 0, sizeof(header));
+}
+
+IndexFile::~IndexFile() {
+    release();
+}
+
+void IndexFile::release() {
+#ifndef _WIN32
+    if (base && ownedCopy.empty()) munmap(const_cast<char*>(base), length);
+#endif
+    ownedCopy.clear();
+    base = nullptr;
+    length = 0;
+    keyData = nullptr;
+    valueData = nullptr;
+    std::memset(&header, 0, sizeof(header));
+}
+
+bool IndexFile::open(const std::string& filename, const char* magic, uint32_t valueSize) {
+    release();
+
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_ERROR("", "Error: Cannot open " << filename << " for reading.");
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexFileHeader)) {
+        LOG_ERROR("IndexFile", filename << " is too short to be an index file");
+        ::close(fd);
+        return false;
+    }
+    void* addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // The mapping keeps its own reference to the file
+    if (addr == MAP_FAILED) {
+        LOG_ERROR("IndexFile", "Failed to map " << filename);
+        return false;
+    }
+    base = static_cast<const char*>(addr);
+    length = (size_t)st.st_size;
+#else
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in) {
+        LOG_ERROR("", "Error: Cannot open " << filename << " for reading.");
+        return false;
+    }
+    ownedCopy.resize((size_t)in.tellg());
+    in.seekg(0);
+    if (ownedCopy.size() < sizeof(IndexFileHeader) || !in.read(ownedCopy.data(), ownedCopy.size())) {
+        LOG_ERROR("IndexFile", filename << " is too short to be an index file");
+        release();
+        return false;
+    }
+    base = ownedCopy.data();
+    length = ownedCopy.size();
+#endif
+
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, magic, sizeof(header.magic)) != 0 ||
+        header.version != INDEX_FILE_VERSION || header.valueSize != valueSize) {
+        LOG_ERROR("IndexFile", filename << " is not a version " << INDEX_FILE_VERSION << " index of this kind");
+        release();
+        return false;
+    }
+
+    uint64_t count = header.entryCount;
+    size_t payload = length - sizeof(IndexFileHeader);
+    if (count > payload / (sizeof(uint64_t) + valueSize) ||
+        payload != count * (sizeof(uint64_t) + valueSize)) {
+        LOG_ERROR("IndexFile", filename << " is truncated or has trailing bytes");
+        release();
+        return false;
+    }
+
+    const char* keyStart = base + sizeof(IndexFileHeader);
+    if (checksum(keyStart, payload) != header.checksum) {
+        LOG_ERROR("IndexFile", filename << " failed its checksum");
+        release();
+        return false;
+    }
+
+    keyData = reinterpret_cast<const uint64_t*>(keyStart);
+    valueData = keyStart + count * sizeof(uint64_t);
+    return true;
+}
+
+bool IndexFile::hasMagic(const std::string& filename, const char* magic) {
+    std::ifstream in(filename, std::ios::binary);
+    char found[8];
+    if (!in.read(found, sizeof(found))) return false;
+    return std::memcmp(found, magic, sizeof(found)) == 0;
+}
+
+bool IndexFile::write(const std::string& filename, const char* magic,
+                      const uint64_t* keys, const void* values, uint32_t valueSize,
+                      uint64_t entryCount, uint64_t sourceGeneration) {
+    // Written beside the target and renamed over it, so a reader that has the
+    // old file mapped keeps its data and nobody sees a half-written index
+    std::string tempName = filename + ".tmp";
+    std::ofstream out(tempName, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        LOG_ERROR("", "Error: Cannot open " << tempName << " for writing.");
+        return false;
+    }
+
+    size_t keyBytes = (size_t)entryCount * sizeof(uint64_t);
+    size_t valueBytes = (size_t)entryCount * valueSize;
+
+    IndexFileHeader fileHeader;
+    std::memset(&fileHeader, 0, sizeof(fileHeader));
+    std::memcpy(fileHeader.magic, magic, sizeof(fileHeader.magic));
+    fileHeader.version = INDEX_FILE_VERSION;
+    fileHeader.valueSize = valueSize;
+    fileHeader.entryCount = entryCount;
+    fileHeader.sourceGeneration = sourceGeneration;
+
+    // The checksum runs over the two sections as if they were one buffer
+    std::vector<char> payload(keyBytes + valueBytes);
+    if (keyBytes) std::memcpy(payload.data(), keys, keyBytes);
+    if (valueBytes) std::memcpy(payload.data() + keyBytes, values, valueBytes);
+    fileHeader.checksum = checksum(payload.data(), payload.size());
+
+    out.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
+    out.write(payload.data(), payload.size());
+    out.close();
+    if (!out.good()) {
+        LOG_ERROR("", "Error: Failed writing " << tempName);
+        std::remove(tempName.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    std::remove(filename.c_str()); // rename does not replace an existing file here
+#endif
+    if (std::rename(tempName.c_str(), filename.c_str()) != 0) {
+        LOG_ERROR("", "Error: Could not replace " << filename << " with " << tempName);
+        std::remove(tempName.c_str());
+        return false;
+    }
+    return true;
+}
+
+uint64_t IndexFile::checksum(const char* data, size_t length, uint64_t seed) {
+    const uint64_t prime = 1099511628211ULL;
+    uint64_t hash = seed;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < length; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    return hash;
+}
@@ -8,6 +8,8 @@
 #include <iostream>
 #include <fstream>
 
+const char IndexManager::FILE_MAGIC[8] = {'Z', 'I', 'P', 'I', 'D', 'X', '\0', '\0'};
+
 /**
  * @brief Builds the index by scanning through the binary data file.
  * 
@@ -21,7 +23,7 @@ void IndexManager::buildIndex(const std::string& dataFileName) {
         return;
     }
 
-    indexMap.clear();
+    beginBuild();
 
     HeaderRecordBuffer header;
     if (!header.readHeader(dataFile)) {
@@ -31,92 +33,145 @@ void IndexManager::buildIndex(const std::string& dataFileName) {
 
     uint64_t offset = dataFile.tellg(); // Get initial offset after header
     uint32_t recordLength = 0;
+    std::string record;
 
     while (dataFile.read(reinterpret_cast<char*>(&recordLength), sizeof(recordLength))) {
-        
-        std::string record(recordLength, '\0');
+        record.resize(recordLength);
         dataFile.read(&record[0], recordLength);
-
-        std::istringstream ss(record);
-        std::string zip;
-        std::getline(ss, zip, ',');
-
-        if (std::all_of(zip.begin(), zip.end(),
-            [](char c){ return std::isdigit(static_cast<unsigned char>(c)); })) {
-            indexMap[zip] = offset; // <-- Store the offset captured BEFORE the read
-        }
+        addRecord(record, offset); // <-- Store the offset captured BEFORE the read
 
         // Get the offset for the NEXT record
         offset = static_cast<uint64_t>(dataFile.tellg());
     }
 
+    dataFile.clear();
+    dataFile.seekg(0, std::ios::end);
+    uint64_t dataFileSize = static_cast<uint64_t>(dataFile.tellg());
     dataFile.close();
+    finishBuild(dataFileSize);
+}
+
+void IndexManager::beginBuild() {
+    keys.clear();
+    offsets.clear();
+    mapped.reset();
+    pending.clear();
+}
+
+void IndexManager::addRecord(std::string_view record, uint64_t offset) {
+    uint64_t key;
+    if (recordKey(record, key)) addEntry(key, offset);
 }
 
 /**
- * @brief Writes the in-memory index map to a binary file.
+ * @brief The ZIP code is the text before the first comma.
  *
- * Format:
- * [entryCount:uint32_t]
- * For each entry:
- *   [keyLen:uint16_t][ZIP chars][offset:uint64_t]
+ * A ZipKey holds only the first PACKED_BYTES characters, so longer codes
+ * could share a key with another record; they are left out of the index.
  */
-void IndexManager::writeIndex(const std::string& indexFileName) const {
-    std::ofstream out(indexFileName, std::ios::binary);
-    if (!out) {
-        std::cerr << "Error: Cannot open " << indexFileName << " for writing.\n";
-        return;
+bool IndexManager::recordKey(std::string_view record, uint64_t& key) {
+    std::string_view zip = record.substr(0, record.find(','));
+    if (zip.size() > ZipKey::PACKED_BYTES || !std::all_of(zip.begin(), zip.end(),
+        [](char c){ return std::isdigit(static_cast<unsigned char>(c)); })) {
+        return false;
     }
+    key = ZipKey(zip).value();
+    return true;
+}
 
-    uint32_t count = static_cast<uint32_t>(indexMap.size());
-    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+void IndexManager::finishBuild(uint64_t dataFileSize) {
+    sourceGeneration = dataFileSize;
+    assign(pending);
+    pending.shrink_to_fit();
+}
 
-    for (const auto& entry : indexMap) {
-        uint16_t keyLen = static_cast<uint16_t>(entry.first.size());
-        out.write(reinterpret_cast<const char*>(&keyLen), sizeof(keyLen));
-        out.write(entry.first.c_str(), keyLen);
-        out.write(reinterpret_cast<const char*>(&entry.second), sizeof(entry.second));
+/**
+ * @brief Replaces the entries with the given (key, offset) pairs, sorted by key.
+ *
+ * Equal keys keep the later pair, as repeated map assignment did.
+ */
+void IndexManager::assign(std::vector<std::pair<uint64_t, uint64_t>>& entries) {
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) {
+                         return a.first < b.first;
+                     });
+    keys.clear();
+    offsets.clear();
+    keys.reserve(entries.size());
+    offsets.reserve(entries.size());
+    for (const auto& entry : entries) {
+        if (!keys.empty() && keys.back() == entry.first) {
+            offsets.back() = entry.second;
+            continue;
+        }
+        keys.push_back(entry.first);
+        offsets.push_back(entry.second);
     }
+    entries.clear();
+}
 
-    out.close();
+/**
+ * @brief Writes the index to a binary file in the IndexFile format.
+ *
+ * Format:
+ * [IndexFileHeader: magic "ZIPIDX", version, counts, data file size, checksum]
+ * [key:uint64_t] x entryCount   (ZipKey values, ascending)
+ * [offset:uint64_t] x entryCount
+ */
+void IndexManager::writeIndex(const std::string& indexFileName) const {
+    IndexFile::write(indexFileName, FILE_MAGIC, keyData(), offsetData(), sizeof(uint64_t),
+                     size(), sourceGeneration);
 }
 
 /**
- * @brief Reads an index file from disk back into memory.
+ * @brief Maps an index file so lookups search it in place.
+ *
+ * The file is used only if it was built from a data file of the current
+ * size; otherwise (or if it is unreadable, or a version 1 file, which
+ * records no size) the index is rebuilt from the data file and rewritten.
  */
-void IndexManager::readIndex(const std::string& indexFileName) {
-    std::ifstream in(indexFileName, std::ios::binary);
-    if (!in) {
-        std::cerr << "Error: Cannot open " << indexFileName << " for reading.\n";
+void IndexManager::readIndex(const std::string& indexFileName, const std::string& dataFileName) {
+    std::ifstream dataFile(dataFileName, std::ios::binary | std::ios::ate);
+    if (!dataFile.is_open()) {
+        std::cerr << "Error: Cannot open " << dataFileName << " to check the index.\n";
         return;
     }
+    uint64_t dataFileSize = static_cast<uint64_t>(dataFile.tellg());
+    dataFile.close();
 
-    indexMap.clear();
-
-    uint32_t count = 0;
-    in.read(reinterpret_cast<char*>(&count), sizeof(count));
-
-    for (uint32_t i = 0; i < count; ++i) {
-        uint16_t keyLen = 0;
-        in.read(reinterpret_cast<char*>(&keyLen), sizeof(keyLen));
-
-        std::string zip(keyLen, '\0');
-        in.read(&zip[0], keyLen);
-
-        uint64_t offset = 0;
-        in.read(reinterpret_cast<char*>(&offset), sizeof(offset));
-
-        indexMap[zip] = offset;
+    keys.clear();
+    offsets.clear();
+    mapped.reset();
+    sourceGeneration = 0;
+
+    std::shared_ptr<IndexFile> file = std::make_shared<IndexFile>();
+    if (IndexFile::hasMagic(indexFileName, FILE_MAGIC) &&
+        file->open(indexFileName, FILE_MAGIC, sizeof(uint64_t))) {
+        if (file->getSourceGeneration() == dataFileSize) {
+            mapped = file;
+            sourceGeneration = file->getSourceGeneration();
+            std::cout << "Loaded index with " << size() << " entries.\n";
+            return;
+        }
+        std::cerr << "Warning: Index " << indexFileName << " was built for another version of "
+                  << dataFileName << "; rebuilding.\n";
+    } else {
+        std::cerr << "Warning: Index " << indexFileName << " is missing, unreadable or in the old format; rebuilding.\n";
     }
 
-    in.close();
-    std::cout << "Loaded index with " << count << " entries.\n";
+    buildIndex(dataFileName);
+    writeIndex(indexFileName);
 }
 
 /**
  * @brief Finds the byte offset for a ZIP code in the index.
  */
 uint64_t IndexManager::findOffset(const std::string& zip) const {
-    auto it = indexMap.find(zip);
-    return (it != indexMap.end()) ? it->second : UINT64_MAX;
+    // Overlong codes are never indexed, and their key would match a different code
+    if (zip.size() > ZipKey::PACKED_BYTES) return UINT64_MAX;
+    uint64_t probe = ZipKey(zip).value();
+    const uint64_t* first = keyData();
+    const uint64_t* last = first + size();
+    const uint64_t* it = std::lower_bound(first, last, probe);
+    return (it != last && *it == probe) ? offsetData()[it - first] : UINT64_MAX;
 }
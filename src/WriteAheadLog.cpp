@@ -0,0 +1,212 @@
+#include "../headers/WriteAheadLog.h"
+#include "../headers/IndexFile.h"
+#include "../headers/Log.h"
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+static_assert(sizeof(WalRecordHeader) == 24, "WalRecordHeader is written raw and must not change size");
+static_assert(sizeof(WalPageHeader) == 16, "WalPageHeader is written raw and must not change size");
+
+namespace {
+
+// Larger records can only come from a damaged length field
+const uint64_t MAX_RECORD_BYTES = 64ull * 1024 * 1024;
+
+bool syncStream(std::FILE* f) {
+    if (std::fflush(f) != 0) return false;
+#ifndef _WIN32
+    return fsync(fileno(f)) == 0;
+#else
+    return _commit(_fileno(f)) == 0;
+#endif
+}
+
+} // namespace
+
+WriteAheadLog::WriteAheadLog()
+    : log(nullptr), unsyncedCount(0), fileBytes(0) {
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+bool WriteAheadLog::open(const std::string& filename) {
+    close();
+    log = std::fopen(filename.c_str(), "wb");
+    if (!log) {
+        LOG_ERROR("WAL", "Cannot open log " << filename);
+        return false;
+    }
+    path = filename;
+    return true;
+}
+
+void WriteAheadLog::close(bool remove) {
+    if (log) std::fclose(log);
+    log = nullptr;
+    buffer.clear();
+    unsyncedCount = 0;
+    fileBytes = 0;
+    if (remove && !path.empty()) std::remove(path.c_str());
+    path.clear();
+}
+
+void WriteAheadLog::append(const std::vector<Page>& pages) {
+    size_t start = buffer.size();
+    buffer.resize(start + sizeof(WalRecordHeader));
+
+    for (const Page& page : pages) {
+        WalPageHeader pageHeader;
+        pageHeader.offset = page.offset;
+        pageHeader.length = page.length;
+        pageHeader.reserved = 0;
+        const char* raw = reinterpret_cast<const char*>(&pageHeader);
+        buffer.insert(buffer.end(), raw, raw + sizeof(pageHeader));
+        buffer.insert(buffer.end(), page.data, page.data + page.length);
+    }
+
+    WalRecordHeader recordHeader;
+    recordHeader.magic = WAL_RECORD_MAGIC;
+    recordHeader.pageCount = (uint32_t)pages.size();
+    recordHeader.payloadBytes = buffer.size() - start - sizeof(WalRecordHeader);
+    recordHeader.checksum = IndexFile::checksum(buffer.data() + start + sizeof(WalRecordHeader),
+                                                (size_t)recordHeader.payloadBytes);
+    std::memcpy(buffer.data() + start, &recordHeader, sizeof(recordHeader));
+    unsyncedCount++;
+}
+
+bool WriteAheadLog::sync() {
+    if (!log) return false;
+    if (buffer.empty()) return true;
+
+    if (std::fwrite(buffer.data(), 1, buffer.size(), log) != buffer.size() || !syncStream(log)) {
+        LOG_ERROR("WAL", "Failed to write " << buffer.size() << " bytes to " << path);
+        return false;
+    }
+    LOG_DEBUG("WAL", "Synced " << unsyncedCount << " operations (" << buffer.size() << " bytes)");
+    fileBytes += buffer.size();
+    buffer.clear();
+    unsyncedCount = 0;
+    return true;
+}
+
+bool WriteAheadLog::reset() {
+    if (!log) return false;
+    buffer.clear();
+    unsyncedCount = 0;
+    if (fileBytes == 0) return true;
+
+    // Reopening for writing truncates; the data file already holds every record
+    log = std::freopen(path.c_str(), "wb", log);
+    if (!log || !syncStream(log)) {
+        LOG_ERROR("WAL", "Failed to truncate " << path);
+        return false;
+    }
+    fileBytes = 0;
+    return true;
+}
+
+bool WriteAheadLog::recover(const std::string& walFilename, const std::string& dataFilename, size_t& applied) {
+    applied = 0;
+    std::FILE* in = std::fopen(walFilename.c_str(), "rb");
+    if (!in) return true;  // No log: nothing to replay
+
+    std::fstream data;
+    std::vector<char> payload;
+    WalRecordHeader recordHeader;
+    bool ok = true;
+    bool sawBytes = false;
+
+    while (std::fread(&recordHeader, sizeof(recordHeader), 1, in) == 1) {
+        sawBytes = true;
+        if (recordHeader.magic != WAL_RECORD_MAGIC || recordHeader.payloadBytes > MAX_RECORD_BYTES) break;
+        payload.resize((size_t)recordHeader.payloadBytes);
+        if (std::fread(payload.data(), 1, payload.size(), in) != payload.size()) break;
+        if (IndexFile::checksum(payload.data(), payload.size()) != recordHeader.checksum) break;
+
+        // pageCount is outside the checksum: a record whose pages do not exactly fill
+        // the payload is treated like a torn tail, and nothing of it is replayed
+        std::vector<WalPageHeader> pages;
+        size_t pos = 0;
+        for (uint32_t i = 0; i < recordHeader.pageCount && pos + sizeof(WalPageHeader) <= payload.size(); ++i) {
+            WalPageHeader pageHeader;
+            std::memcpy(&pageHeader, payload.data() + pos, sizeof(pageHeader));
+            pos += sizeof(pageHeader);
+            if (pageHeader.length > payload.size() - pos) break;
+            pages.push_back(pageHeader);
+            pos += pageHeader.length;
+        }
+        if (pages.size() != recordHeader.pageCount || pos != payload.size()) {
+            LOG_WARN("WAL", "Record " << applied << " of " << walFilename
+                     << " has inconsistent page headers; replay stops there");
+            break;
+        }
+
+        if (!data.is_open()) {
+            data.open(dataFilename, std::ios::in | std::ios::out | std::ios::binary);
+            if (!data) {
+                LOG_ERROR("WAL", "Cannot open " << dataFilename << " to replay " << walFilename);
+                ok = false;
+                break;
+            }
+        }
+
+        pos = 0;
+        for (const WalPageHeader& pageHeader : pages) {
+            pos += sizeof(pageHeader);
+            data.seekp((std::streamoff)pageHeader.offset, std::ios::beg);
+            data.write(payload.data() + pos, pageHeader.length);
+            pos += pageHeader.length;
+        }
+        if (!data.good()) {
+            LOG_ERROR("WAL", "Failed to replay record " << applied << " of " << walFilename);
+            ok = false;
+            break;
+        }
+        applied++;
+    }
+    std::fclose(in);
+    if (!ok) return false;
+
+    if (data.is_open()) {
+        data.close();
+        if (!syncFile(dataFilename)) {
+            LOG_ERROR("WAL", "Failed to sync " << dataFilename << " after replay");
+            return false;
+        }
+    }
+    if (sawBytes) {
+        LOG_INFO("WAL", "Replayed " << applied << " logged operations into " << dataFilename);
+    }
+
+    // The file now holds every replayed change, so the log can go
+    if (std::remove(walFilename.c_str()) != 0) {
+        LOG_ERROR("WAL", "Failed to remove " << walFilename << " after replay");
+        return false;
+    }
+    return true;
+}
+
+bool WriteAheadLog::syncFile(const std::string& filename) {
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#else
+    std::FILE* f = std::fopen(filename.c_str(), "rb+");
+    if (!f) return false;
+    bool ok = syncStream(f);
+    std::fclose(f);
+    return ok;
+#endif
+}
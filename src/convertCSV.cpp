@@ -7,7 +7,15 @@
 #include "HeaderBuffer.h"
 #include "IndexManager.h"
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
 using namespace std;
 
 //Authors: Team 5
@@ -15,7 +23,142 @@ using namespace std;
 /*Purpose: This file contains the implementation of functions to read a CSV file and
  write its contents to a binary file with length-prefixed records. */
 
-void processFile(string& inputFileName, const string& outputFileName) {
+namespace {
+
+const size_t CHUNK_BYTES = 4 << 20;   // Input read per chunk; chunks always end on a line break
+
+// A run of whole CSV lines and the length-prefixed records made from them
+struct ConvertChunk {
+    uint64_t sequence = 0;                               // Position in the input
+    string text;                                         // Lines as read
+    string output;                                       // [len:uint32][line] per non-empty line
+    vector<pair<uint64_t, uint64_t>> keys;               // (ZipKey value, offset within output)
+    uint64_t records = 0;
+};
+
+/**
+ * @brief Blocking FIFO of chunk pointers with a fixed capacity.
+ * @note Chunks circulate free -> read -> parsed -> free, so every queue is
+ *       sized for the whole pool and the pool bounds the memory in flight.
+ */
+class ChunkQueue {
+public:
+    explicit ChunkQueue(size_t cap) : capacity(cap), closed(false) {}
+
+    void push(ConvertChunk* chunk) {
+        unique_lock<mutex> lock(guard);
+        spaceFree.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(chunk);
+        itemReady.notify_one();
+    }
+
+    // Null once the queue is closed and empty
+    ConvertChunk* pop() {
+        unique_lock<mutex> lock(guard);
+        itemReady.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) return nullptr;
+        ConvertChunk* chunk = items.front();
+        items.pop_front();
+        spaceFree.notify_one();
+        return chunk;
+    }
+
+    void close() {
+        lock_guard<mutex> lock(guard);
+        closed = true;
+        itemReady.notify_all();
+    }
+
+private:
+    size_t capacity;
+    bool closed;
+    deque<ConvertChunk*> items;
+    mutex guard;
+    condition_variable itemReady;
+    condition_variable spaceFree;
+};
+
+/**
+ * @brief Cuts the CSV into chunks of whole lines, dropping the header row.
+ */
+class ChunkReader {
+public:
+    explicit ChunkReader(istream& in) : input(in), sequence(0), headerSkipped(false) {}
+
+    // Fills chunk.text; false once the input is used up
+    bool next(ConvertChunk& chunk) {
+        chunk.text.swap(carry);
+        carry.clear();
+        for (;;) {
+            size_t used = chunk.text.size();
+            chunk.text.resize(used + CHUNK_BYTES);
+            input.read(&chunk.text[used], CHUNK_BYTES);
+            size_t got = (size_t)input.gcount();
+            chunk.text.resize(used + got);
+
+            if (!headerSkipped) {
+                size_t headerEnd = chunk.text.find('\n');
+                if (headerEnd == string::npos) {
+                    if (got > 0) continue;
+                    chunk.text.clear();
+                } else {
+                    chunk.text.erase(0, headerEnd + 1);
+                }
+                headerSkipped = true;
+            }
+
+            if (got == 0) break;  // End of input: the last line needs no line break
+            size_t lastBreak = chunk.text.rfind('\n');
+            if (lastBreak != string::npos) {
+                carry.assign(chunk.text, lastBreak + 1, string::npos);
+                chunk.text.resize(lastBreak + 1);
+                break;
+            }
+        }
+        chunk.sequence = sequence++;
+        return !chunk.text.empty();
+    }
+
+private:
+    istream& input;
+    string carry;   // Partial line left over from the last read
+    uint64_t sequence;
+    bool headerSkipped;
+};
+
+// Turns each non-empty line of chunk.text into a length-prefixed record
+void formatChunk(ConvertChunk& chunk) {
+    chunk.output.clear();
+    chunk.keys.clear();
+    chunk.records = 0;
+    const string& text = chunk.text;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == string::npos) end = text.size();
+        if (end > pos) {
+            string_view line(text.data() + pos, end - pos);
+            uint64_t key;
+            if (IndexManager::recordKey(line, key)) chunk.keys.emplace_back(key, chunk.output.size());
+            uint32_t recordLength = static_cast<uint32_t>(line.size());
+            chunk.output.append(reinterpret_cast<const char*>(&recordLength), sizeof(recordLength));
+            chunk.output.append(line);
+            ++chunk.records;
+        }
+        pos = end + 1;
+    }
+}
+
+unsigned resolveThreadCount(unsigned requested) {
+    if (requested != 0) return requested;
+    unsigned hw = thread::hardware_concurrency();
+    return hw ? hw : 1;
+}
+
+} // namespace
+
+void processFile(string& inputFileName, const string& outputFileName, unsigned threads,
+                 const string& indexFileName) {
     ifstream inputFile(inputFileName);
     ofstream outputFile(outputFileName, ios::binary);
 
@@ -28,7 +171,7 @@ void processFile(string& inputFileName, const string& outputFileName) {
     
     // Set all the metadata
     header.version = 2; 
-    header.indexFileName = "Data/zip.idx";
+    header.indexFileName = indexFileName;
     header.primaryKeyFieldIndex = 0; 
     
     
@@ -39,36 +182,91 @@ void processFile(string& inputFileName, const string& outputFileName) {
     header.fields.push_back({"Latitude", DataType::DOUBLE});
     header.fields.push_back({"Longitude", DataType::DOUBLE});
 
-    uint32_t recordCount = 0;
-    string tempLine;
-    getline(inputFile, tempLine); 
-    while (std::getline(inputFile, tempLine)) {
-        if (!tempLine.empty()) {
-            ++recordCount;
-        }
-    }
-    header.recordCount = recordCount; // Set the count
- 
+    // Single pass: the count is written as 0 here and patched once the records are out
+    std::streampos headerStart = outputFile.tellp();
     header.writeHeader(outputFile);
+    uint64_t offset = static_cast<uint64_t>(outputFile.tellp());
+
+    IndexManager index;
+    index.beginBuild();
+    bool writeFailed = false;
 
-    inputFile.clear();
-    inputFile.seekg(0, std::ios::beg);
-    getline(inputFile, tempLine); 
+    // Appends one formatted chunk to the file and its keys to the index
+    auto writeChunk = [&](const ConvertChunk& chunk) {
+        if (writeFailed) return;
+        outputFile.write(chunk.output.data(), (streamsize)chunk.output.size());
+        if (!outputFile.good()) {
+            writeFailed = true;
+            return;
+        }
+        for (const auto& entry : chunk.keys) {
+            index.addEntry(entry.first, offset + entry.second);
+        }
+        offset += chunk.output.size();
+        header.recordCount += chunk.records;
+    };
+
+    ChunkReader reader(inputFile);
+    unsigned parserCount = resolveThreadCount(threads);
+    if (parserCount == 1) {
+        ConvertChunk chunk;
+        while (reader.next(chunk)) {
+            formatChunk(chunk);
+            writeChunk(chunk);
+        }
+    } else {
+        // Reader thread -> parser pool -> this thread, which writes chunks in input order
+        const size_t poolSize = 2 * (size_t)parserCount + 2;
+        vector<ConvertChunk> pool(poolSize);
+        ChunkQueue freeChunks(poolSize), readChunks(poolSize), parsedChunks(poolSize);
+        for (auto& chunk : pool) freeChunks.push(&chunk);
+
+        thread readerThread([&] {
+            for (;;) {
+                ConvertChunk* chunk = freeChunks.pop();
+                if (!reader.next(*chunk)) break;
+                readChunks.push(chunk);
+            }
+            readChunks.close();
+        });
 
-    string line;
-    while (getline(inputFile, line)) {
-        if (!line.empty()) {
-            lenRead(outputFile, line); 
+        vector<thread> parsers;
+        atomic<unsigned> parsersLeft(parserCount);
+        for (unsigned i = 0; i < parserCount; ++i) {
+            parsers.emplace_back([&] {
+                while (ConvertChunk* chunk = readChunks.pop()) {
+                    formatChunk(*chunk);
+                    parsedChunks.push(chunk);
+                }
+                if (--parsersLeft == 0) parsedChunks.close();
+            });
         }
+
+        map<uint64_t, ConvertChunk*> waiting;  // Parsed ahead of the next chunk to write
+        uint64_t nextSequence = 0;
+        while (ConvertChunk* chunk = parsedChunks.pop()) {
+            waiting.emplace(chunk->sequence, chunk);
+            for (auto it = waiting.begin(); it != waiting.end() && it->first == nextSequence;
+                 it = waiting.erase(it), ++nextSequence) {
+                writeChunk(*it->second);
+                freeChunks.push(it->second);
+            }
+        }
+
+        readerThread.join();
+        for (auto& parser : parsers) parser.join();
     }
-    
 
-    IndexManager index;
-    index.buildIndex(outputFileName); 
+    if (writeFailed || !header.rewriteRecordCount(outputFile, headerStart)) {
+        cerr << "Error writing " << outputFileName << endl;
+        return;
+    }
+    outputFile.close();
+    inputFile.close();
+
+    index.finishBuild(offset);
     index.writeIndex(header.indexFileName); // Use the filename from the header
 
-    inputFile.close();
-    outputFile.close();
     cout << "Binary file and index created successfully with new header format." << endl;
 }
 
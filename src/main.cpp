@@ -6,13 +6,20 @@
 #include <sstream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
 #include "ZipCodeRecordBuffer.h"
+#include "RecordView.h"
 #include "HeaderBuffer.h"
 #include "convertCSV.h"
 #include "IndexManager.h"
 #include "BSSFile.h"
 #include "BSSBlock.h"
 #include "BSSIndex.h"
+#include "Benchmark.h"
 
 using namespace std;
 
@@ -40,19 +47,52 @@ struct StateRecord {
 //  testBin.close();
 //  }
 
+/**
+ * @brief Prints the block cache counters, used to size the cache for a workload
+ */
+void printCacheStats(const BSSFile& file) {
+    if (file.isMapped()) {
+        cout << "Block cache: not used (file is memory-mapped read-only)\n";
+        return;
+    }
+    const CacheStats& stats = file.getCacheStats();
+    cout << "Block cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+         << stats.evictions << " evictions, " << stats.writeBacks << " write-backs"
+         << " (hit ratio " << fixed << setprecision(1) << stats.hitRatio() * 100.0 << "%)\n";
+    cout.unsetf(ios::fixed);
+    cout << setprecision(6);
+}
+
 /**
  * @brief Creates a blocked sequence set file from the Project 2.0 binary file
  */
 
-void createBSSFile(const string& binaryFile, const string& bssFile) {
+void createBSSFile(const string& binaryFile, const string& bssFile,
+                   BSSCreateOptions options = BSSCreateOptions()) {
     cout << "\n=== Creating Blocked Sequence Set File ===\n";
     BSSFile file;
-    if (!file.create(bssFile, binaryFile)) {
+    options.threads = 0; // One worker per hardware thread
+    if (!file.create(bssFile, binaryFile, options)) {
         cerr << "Error: Failed to create BSS file.\n";
         return;
     }
     file.close();
-    cout << "BSS file '" << bssFile << "' created successfully.\n";
+    cout << "BSS file '" << bssFile << "' and index '" << bssFile << ".idx' created successfully.\n";
+}
+
+/**
+ * @brief Creates a BSS file and its index straight from the CSV source
+ */
+void createBSSFileFromCsv(const string& csvFile, const string& bssFile,
+                          BSSCreateOptions options = BSSCreateOptions()) {
+    cout << "\n=== Creating Blocked Sequence Set File from CSV ===\n";
+    BSSFile file;
+    options.threads = 0; // One worker per hardware thread
+    if (!file.createFromCsv(bssFile, csvFile, options)) {
+        cerr << "Error: Failed to create BSS file.\n";
+        return;
+    }
+    cout << "BSS file '" << bssFile << "' and index '" << bssFile << ".idx' created successfully.\n";
 }
 
 /**
@@ -61,7 +101,7 @@ void createBSSFile(const string& binaryFile, const string& bssFile) {
 void searchBSSFile(const string& bssFile, const vector<string>& zipCodes) {
     cout << "\n=== Searching BSS File ===\n";
     BSSFile file;
-    if (!file.open(bssFile)) {
+    if (!file.open(bssFile, BSSFile::OpenMode::MappedReadOnly)) {
         cerr << "Error: Could not open BSS file '" << bssFile << "'.\n";
         return;
     }
@@ -87,17 +127,13 @@ void searchBSSFile(const string& bssFile, const vector<string>& zipCodes) {
                 break;
             }
 
-            // Step 2: Block buffer unpacks records into record buffers
-            vector<ZipCodeRecordBuffer> records = block.unpackAllRecords();
-
-            // Step 3: Record buffer provides field access
-            for (const auto& rec : records) {
-                if (rec.getZipCode() == zip) {
-                    cout << "  Found in Block " << rbn << ": ";
-                    rec.print();
-                    found = true;
-                    break;
-                }
+            // Step 2: Block buffer looks the key up and returns a view of the match
+            RecordView rec;
+            if (block.findRecord(zip, rec)) {
+                // Step 3: Record buffer provides field access
+                cout << "  Found in Block " << rbn << ": ";
+                rec.print();
+                found = true;
             }
 
             // Move to next block in sequence
@@ -110,6 +146,7 @@ void searchBSSFile(const string& bssFile, const vector<string>& zipCodes) {
         cout << "\n";
     }
 
+    printCacheStats(file);
     file.close();
 }
 
@@ -119,13 +156,14 @@ void searchBSSFile(const string& bssFile, const vector<string>& zipCodes) {
 void displayAllRecords(const string& bssFile) {
     cout << "\n=== Displaying All Records from BSS File ===\n";
     BSSFile file;
-    if (!file.open(bssFile)) {
+    if (!file.open(bssFile, BSSFile::OpenMode::MappedReadOnly)) {
         cerr << "Error: Could not open BSS file.\n";
         return;
     }
 
     const BSSFileHeader& header = file.getHeader();
     int rbn = header.getListHeadRBN();
+    file.adviseAccess(BSSFile::AccessPattern::Sequential);
     int recordCount = 0;
 
     while (rbn != -1) {
@@ -133,12 +171,9 @@ void displayAllRecords(const string& bssFile) {
         BSSBlock block(header.getBlockSize());
         if (!file.readBlock(rbn, block)) break;
 
-        // Block buffer unpacks to record buffers
-        vector<ZipCodeRecordBuffer> records = block.unpackAllRecords();
-
-        // Display records using record buffer accessors
-        cout << "\n--- Block " << rbn << " (" << records.size() << " records) ---\n";
-        for (const auto& rec : records) {
+        // Display records through views into the block buffer
+        cout << "\n--- Block " << rbn << " (" << block.getHeader()->recordCount << " records) ---\n";
+        for (const RecordView& rec : block) {
             rec.print();
             recordCount++;
         }
@@ -156,31 +191,33 @@ void displayAllRecords(const string& bssFile) {
 void findExtremeZipCodes(const string& bssFile) {
     cout << "\n=== Finding Extreme Zip Codes by State ===\n";
     BSSFile file;
-    if (!file.open(bssFile)) {
+    if (!file.open(bssFile, BSSFile::OpenMode::MappedReadOnly)) {
         cerr << "Error: Could not open BSS file.\n";
         return;
     }
 
-    map<string, StateRecord> stateMap;
+    map<string, StateRecord, less<>> stateMap;
     const BSSFileHeader& header = file.getHeader();
     int rbn = header.getListHeadRBN();
+    file.adviseAccess(BSSFile::AccessPattern::Sequential);
 
     // Process all blocks sequentially
     while (rbn != -1) {
         BSSBlock block(header.getBlockSize());
         if (!file.readBlock(rbn, block)) break;
 
-        // Unpack records from block buffer to record buffers
-        vector<ZipCodeRecordBuffer> records = block.unpackAllRecords();
-
-        // Process each record
-        for (const auto& rec : records) {
-            string state = rec.getState();
-            string zip = rec.getZipCode();
+        // Process each record through a view into the block buffer
+        for (const RecordView& rec : block) {
+            string_view state = rec.getState();
+            string_view zip = rec.getZipCode();
             double lat = rec.getLatitude();
             double lon = rec.getLongitude();
 
-            StateRecord& sr = stateMap[state];
+            auto found = stateMap.find(state);
+            if (found == stateMap.end()) {
+                found = stateMap.emplace(string(state), StateRecord()).first;
+            }
+            StateRecord& sr = found->second;
 
             // Update extremes
             if (lon > sr.easternmost_lon) {
@@ -230,72 +267,49 @@ void searchWithIndex(const string& bssFile, const string& indexFile, const vecto
     
     // Open BSS file
     BSSFile file;
-    if (!file.open(bssFile)) {
+    if (!file.open(bssFile, BSSFile::OpenMode::MappedReadOnly)) {
         cerr << "Error: Could not open BSS file '" << bssFile << "'.\n";
         return;
     }
 
-    // Load index from file (or build if doesn't exist)
-    BSSIndex index;
-    ifstream testIdx(indexFile, ios::binary);
-    if (testIdx.good()) {
-        testIdx.close();
-        cout << "Loading existing index from '" << indexFile << "'...\n";
-        if (!index.read(indexFile)) {
-            cerr << "Error reading index. Rebuilding...\n";
-            index.build(file);
-            index.write(indexFile);
-        }
-    } else {
-        testIdx.close();
-        cout << "Index not found. Building new index...\n";
-        index.build(file);
-        index.write(indexFile);
-        cout << "Index saved to '" << indexFile << "'.\n";
+    // Load index from file (rebuilt if missing, damaged or stale)
+    cout << "Loading index from '" << indexFile << "'...\n";
+    if (!file.loadIndex(indexFile)) {
+        cerr << "Error: Could not save index to '" << indexFile << "'.\n";
     }
+    const BSSIndex& index = file.getIndex();
 
-    // Search for each zip code using the index
-    for (const auto& zip : zipCodes) {
-        cout << "\nSearching for ZIP: " << zip << "\n";
-        
-        // Step 1: Use index to find the block
-        int rbn = index.findRBN(zip);
-        if (rbn == -1) {
-            cout << "  ZIP code " << zip << " not found (no matching block in index).\n";
-            continue;
-        }
+    // Look all zip codes up in one batch: each block is read once, in RBN order
+    vector<BSSFile::LookupResult> results = file.lookupBatch(zipCodes, index);
+    vector<int> blocksTouched;
 
-        cout << "  Index indicates block RBN: " << rbn << "\n";
+    for (const auto& result : results) {
+        cout << "\nSearching for ZIP: " << result.zipCode << "\n";
 
-        // Step 2: Read the indexed block
-        BSSBlock block(file.getHeader().getBlockSize());
-        if (!file.readBlock(rbn, block)) {
-            cerr << "  Error reading block " << rbn << "\n";
+        if (result.rbn == -1) {
+            cout << "  ZIP code " << result.zipCode << " not found (no matching block in index).\n";
             continue;
         }
 
-        // Step 3: Unpack records from the block
-        vector<ZipCodeRecordBuffer> records = block.unpackAllRecords();
-        cout << "  Block contains " << records.size() << " records.\n";
+        cout << "  Index indicates block RBN: " << result.rbn << "\n";
+        blocksTouched.push_back(result.rbn);
 
-        // Step 4: Search within the block
-        bool found = false;
-        for (const auto& rec : records) {
-            if (rec.getZipCode() == zip) {
-                cout << "  [FOUND]: ";
-                rec.print();
-                found = true;
-                break;
-            }
-        }
-
-        // Step 5: Confirm if not found after searching the block
-        if (!found) {
-            cout << "  [NOT FOUND]: ZIP code " << zip << " not found in block " << rbn
+        if (result.found) {
+            cout << "  [FOUND]: ";
+            result.record.print();
+        } else {
+            cout << "  [NOT FOUND]: ZIP code " << result.zipCode << " not found in block " << result.rbn
                  << " (block was read, unpacked, and searched).\n";
         }
     }
 
+    sort(blocksTouched.begin(), blocksTouched.end());
+    blocksTouched.erase(unique(blocksTouched.begin(), blocksTouched.end()), blocksTouched.end());
+    cout << "\n" << zipCodes.size() << " lookup(s) answered from " << blocksTouched.size()
+         << " block read(s).\n";
+
+    cout << "\n";
+    printCacheStats(file);
     file.close();
 }
 
@@ -324,20 +338,17 @@ void runSearchTest(const string& bssFile, const string& indexFile) {
     
     // Open BSS file
     BSSFile file;
-    if (!file.open(bssFile)) {
+    if (!file.open(bssFile, BSSFile::OpenMode::MappedReadOnly)) {
         cerr << "Error: Could not open BSS file.\n";
         return;
     }
 
     // Load index into RAM (never load entire BSS file into RAM)
-    BSSIndex index;
     cout << "\n[Loading index into RAM...]\n";
-    if (!index.read(indexFile)) {
-        cout << "[Index not found - building new index...]\n";
-        index.build(file);
-        index.write(indexFile);
-        cout << "[Index saved to '" << indexFile << "']\n";
+    if (!file.loadIndex(indexFile)) {
+        cout << "[Index could not be saved to '" << indexFile << "']\n";
     }
+    const BSSIndex& index = file.getIndex();
     cout << "[Index loaded successfully - BSS file remains on disk]\n\n";
 
     // Search for each zip code
@@ -365,21 +376,16 @@ void runSearchTest(const string& bssFile, const string& indexFile) {
             continue;
         }
 
-        // Step 3: Unpack records from the block
-        vector<ZipCodeRecordBuffer> records = block.unpackAllRecords();
-        cout << "  → Block contains " << records.size() << " records\n";
+        cout << "  → Block contains " << block.getHeader()->recordCount << " records\n";
 
-        // Step 4: Search within the block
-        bool found = false;
-        for (const auto& rec : records) {
-            if (rec.getZipCode() == zip) {
-                cout << "  [VALID]: Found in block " << rbn << "\n";
-                cout << "     ";
-                rec.print();
-                found = true;
-                validCount++;
-                break;
-            }
+        // Step 3-4: Search within the block; the match is a view into the block buffer
+        RecordView rec;
+        bool found = block.findRecord(zip, rec);
+        if (found) {
+            cout << "  [VALID]: Found in block " << rbn << "\n";
+            cout << "     ";
+            rec.print();
+            validCount++;
         }
 
         // Step 5: Confirm not found after searching the block
@@ -390,6 +396,7 @@ void runSearchTest(const string& bssFile, const string& indexFile) {
         }
     }
 
+    printCacheStats(file);
     file.close();
     
     // Summary
@@ -420,7 +427,7 @@ void interactiveSearch(const string& bssFile, const string& indexFile) {
     
     // Open BSS file
     BSSFile file;
-    if (!file.open(bssFile)) {
+    if (!file.open(bssFile, BSSFile::OpenMode::MappedReadOnly)) {
         cerr << "Error: Could not open BSS file '" << bssFile << "'.\n";
         return;
     }
@@ -430,25 +437,12 @@ void interactiveSearch(const string& bssFile, const string& indexFile) {
     cout << "Total Blocks: " << file.getHeader().getBlockCount() << "\n";
     cout << "Total Records: " << file.getHeader().getRecordCount() << "\n\n";
 
-    // Load or build index
-    BSSIndex index;
-    ifstream testIdx(indexFile, ios::binary);
-    if (testIdx.good()) {
-        testIdx.close();
-        cout << "Loading existing index from '" << indexFile << "'...\n";
-        if (!index.read(indexFile)) {
-            cout << "Error reading index. Building new index...\n";
-            index.build(file);
-            index.write(indexFile);
-            cout << "Index saved to '" << indexFile << "'.\n";
-        }
-    } else {
-        testIdx.close();
-        cout << "Index not found. Building new index...\n";
-        index.build(file);
-        index.write(indexFile);
-        cout << "Index saved to '" << indexFile << "'.\n";
+    // Load index (rebuilt if missing, damaged or stale)
+    cout << "Loading index from '" << indexFile << "'...\n";
+    if (!file.loadIndex(indexFile)) {
+        cout << "Index could not be saved to '" << indexFile << "'.\n";
     }
+    const BSSIndex& index = file.getIndex();
     cout << "Index ready for searching.\n\n";
 
     // Interactive loop
@@ -466,6 +460,7 @@ void interactiveSearch(const string& bssFile, const string& indexFile) {
         if (zipCode == "quit" || zipCode == "q" || zipCode == "exit") {
             cout << "\n" << string(80, '-') << "\n";
             cout << "Total searches performed: " << searchCount << "\n";
+            printCacheStats(file);
             cout << "Exiting interactive mode.\n";
             break;
         }
@@ -491,19 +486,14 @@ void interactiveSearch(const string& bssFile, const string& indexFile) {
             continue;
         }
 
-        // Step 3: Unpack records from the block
-        vector<ZipCodeRecordBuffer> records = block.unpackAllRecords();
-        cout << "  → Block contains " << records.size() << " records\n";
+        cout << "  → Block contains " << block.getHeader()->recordCount << " records\n";
 
-        // Step 4: Search within the block
-        bool found = false;
-        for (const auto& rec : records) {
-            if (rec.getZipCode() == zipCode) {
-                cout << "  [FOUND]:\n    ";
-                rec.print();
-                found = true;
-                break;
-            }
+        // Step 3-4: Search within the block; the match is a view into the block buffer
+        RecordView rec;
+        bool found = block.findRecord(zipCode, rec);
+        if (found) {
+            cout << "  [FOUND]:\n    ";
+            rec.print();
         }
 
         // Step 5: Confirm if not found after searching the block
@@ -531,6 +521,9 @@ void testRecordAddition(const string& bssFile, const string& indexFile) {
         return;
     }
 
+    // Start from the saved index; the additions keep it in sync
+    file.loadIndex(indexFile);
+
     cout << "Initial State:\n";
     cout << "  Total Blocks: " << file.getHeader().getBlockCount() << "\n";
     cout << "  Total Records: " << file.getHeader().getRecordCount() << "\n";
@@ -638,21 +631,17 @@ void testRecordAddition(const string& bssFile, const string& indexFile) {
     cout << "Run full dumps separately if needed.\n";
     cout << string(80, '-') << "\n";
 
-    file.close();
-
-    // Rebuild index
-    cout << "\nRebuilding index after additions...\n";
-    if (file.open(bssFile)) {
-        BSSIndex index;
-        index.build(file);
-        index.write(indexFile);
-        cout << "✓ Index rebuilt and saved\n";
-        
-        cout << "\n=== Updated Index Dump ===\n";
-        index.dump(cout);
-        
-        file.close();
+    // The file kept its index in sync during the additions, so just save it
+    cout << "\nSaving index maintained during additions...\n";
+    if (file.saveIndex()) {
+        cout << "✓ Index saved\n";
     }
+    const BSSIndex& index = file.getIndex();
+
+    cout << "\n=== Updated Index Dump ===\n";
+    index.dump(cout);
+
+    file.close();
 
     cout << "\n" << string(80, '=') << "\n";
     cout << "PHASE 1 TEST COMPLETE\n";
@@ -720,9 +709,9 @@ void createSmallTestFile(const string& bssFile, int blockSize = 128) {
 
     // Now create BSS file from test data
     BSSFile file;
-    // Temporarily modify block size (would need to pass as parameter)
-    // For now, use default 512
-    if (file.create(bssFile, testDataFile)) {
+    BSSCreateOptions options;
+    options.blockSize = (uint32_t)blockSize;
+    if (file.create(bssFile, testDataFile, options)) {
         cout << "✓ Small test BSS file created: " << bssFile << "\n";
         file.close();
         
@@ -741,6 +730,108 @@ void createSmallTestFile(const string& bssFile, int blockSize = 128) {
     }
 }
 
+/**
+ * @brief Rewrites a BSS file in the current block format along with its index
+ */
+void upgradeBSSFile(const string& oldBssFile, const string& newBssFile) {
+    cout << "\n=== Upgrading BSS File ===\n";
+    if (!BSSFile::upgrade(oldBssFile, newBssFile)) {
+        cerr << "Error: Failed to upgrade '" << oldBssFile << "'.\n";
+        return;
+    }
+
+    // RBNs changed; upgrade wrote a fresh index while packing the blocks
+    cout << "Index saved to '" << newBssFile << ".idx'.\n";
+}
+
+/**
+ * @brief Parses a whole non-negative integer argument no larger than maxValue.
+ * @return false (after reporting what was expected) if the text is not such a number
+ */
+bool parseCount(const string& text, const string& name, size_t& value, size_t maxValue = numeric_limits<size_t>::max()) {
+    // strtoull would accept a sign or leading spaces, so the first character must be a digit
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = 0;
+    if (!text.empty() && isdigit((unsigned char)text[0])) {
+        parsed = strtoull(text.c_str(), &end, 10);
+    }
+    if (end == nullptr || *end != '\0' || errno == ERANGE || parsed > maxValue) {
+        cerr << "Error: Invalid " << name << " '" << text << "', expected a whole number";
+        if (maxValue != numeric_limits<size_t>::max()) cerr << " up to " << maxValue;
+        cerr << "\n";
+        return false;
+    }
+    value = (size_t)parsed;
+    return true;
+}
+
+/**
+ * @brief Parses a finite decimal argument.
+ * @return false (after reporting what was expected) if the text is not such a number
+ */
+bool parseDecimal(const string& text, const string& name, double& value) {
+    char* end = nullptr;
+    errno = 0;
+    double parsed = strtod(text.c_str(), &end);
+    if (end == text.c_str() || *end != '\0' || errno == ERANGE || !isfinite(parsed)) {
+        cerr << "Error: Invalid " << name << " '" << text << "', expected a number\n";
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+/**
+ * @brief Reads the --create options that follow the input and output file names.
+ * @return false if a numeric option has an invalid value
+ */
+bool parseCreateOptions(int argc, char* argv[], BSSCreateOptions& options) {
+    for (int i = 4; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        if (option == "--memory") {
+            size_t mib;
+            if (!parseCount(argv[i + 1], "--memory", mib, numeric_limits<size_t>::max() / (1024 * 1024))) return false;
+            options.memoryBudget = mib * 1024 * 1024;
+        } else if (option == "--block-size") {
+            size_t bytes;
+            if (!parseCount(argv[i + 1], "--block-size", bytes, numeric_limits<uint32_t>::max())) return false;
+            options.blockSize = (uint32_t)bytes;
+        } else if (option == "--fill") {
+            if (!parseDecimal(argv[i + 1], "--fill", options.fillFactor)) return false;
+        } else if (option == "--records") {
+            string encoding = argv[i + 1];
+            if (encoding == "text") {
+                options.recordEncoding = RecordEncoding::Text;
+            } else if (encoding == "fixed") {
+                options.recordEncoding = RecordEncoding::BinaryFixed;
+            } else if (encoding == "double") {
+                options.recordEncoding = RecordEncoding::BinaryDouble;
+            } else if (encoding == "dict") {
+                options.recordEncoding = RecordEncoding::BinaryDictionary;
+            } else {
+                cerr << "Warning: Unknown record encoding '" << encoding << "', using text\n";
+            }
+        } else if (option == "--block-format") {
+            string format = argv[i + 1];
+            if (format == "slotted") {
+                options.formatVersion = BSS_VERSION_SLOTTED;
+            } else if (format == "front") {
+                options.formatVersion = BSS_VERSION_FRONT_CODED;
+            } else {
+                cerr << "Warning: Unknown block format '" << format << "', using slotted\n";
+            }
+        } else {
+            cerr << "Warning: Ignoring invalid argument '" << option << "'\n";
+        }
+    }
+    // Options come in pairs, so an odd count leaves the last one without a value
+    if (argc > 4 && (argc - 4) % 2 != 0) {
+        cerr << "Warning: Ignoring option '" << argv[argc - 1] << "' with no value\n";
+    }
+    return true;
+}
+
 void printUsage(const char* programName) {
     cout << "\nUsage:\n";
     cout << "  " << programName << " -i | --interactive\n";
@@ -749,6 +840,27 @@ void printUsage(const char* programName) {
     cout << "      Run search test demonstration with valid and invalid zip codes\n\n";
     cout << "  " << programName << " --test-add\n";
     cout << "      Run record addition test (Phase 1: block splitting)\n\n";
+    cout << "  " << programName << " --upgrade <bss_file> [<new_bss_file>]\n";
+    cout << "      Rewrite a BSS file in the current block format (in place if no new file)\n\n";
+    cout << "  " << programName << " --create <dat_file> <bss_file> [--memory <mib>] [--block-size <bytes>] [--fill <0..1>]"
+         << " [--records text|fixed|double|dict] [--block-format slotted|front]\n";
+    cout << "      Build a BSS file; with a memory budget, sort externally through temp files\n\n";
+    cout << "  " << programName << " --create-csv <csv_file> <bss_file> [same options as --create]\n";
+    cout << "      Build a BSS file and its index in one read of the CSV, without a .dat file\n\n";
+    cout << "  " << programName << " --bench-lookup [<bss_file> [<count>]]\n";
+    cout << "      Compare point-lookup throughput of fstream and memory-mapped access\n\n";
+    cout << "  " << programName << " --bench-layout [<dat_file>]\n";
+    cout << "      Sweep block size x fill factor: file size, lookup latency, insert cost\n\n";
+    cout << "  " << programName << " --bench-create [<dat_file> [<replicas> [<max_threads>]]]\n";
+    cout << "      Time file creation with 1, 2, 4, ... threads on a replicated input\n\n";
+    cout << "  " << programName << " --bench-convert [<csv_file> [<replicas> [<max_threads>]]]\n";
+    cout << "      Time CSV to .dat conversion with 1, 2, 4, ... threads on a replicated input\n\n";
+    cout << "  " << programName << " --bench-index [<max_entries> [<count>]]\n";
+    cout << "      Compare findRBN on a std::map index and the flat sorted-array index\n\n";
+    cout << "  " << programName << " --bench-apply [<bss_file> [<max_changes>]]\n";
+    cout << "      Compare per-record inserts/deletes with one sorted applyChanges pass\n\n";
+    cout << "  " << programName << " --bench-parse [<csv_file> ...]\n";
+    cout << "      Compare the old istringstream record parser with the string_view parser\n\n";
     cout << "  " << programName << " <bss_file> -Z<zip1> [-Z<zip2> ...]\n";
     cout << "      Search for specific zip codes\n\n";
     cout << "  " << programName << "\n";
@@ -757,6 +869,16 @@ void printUsage(const char* programName) {
     cout << "  -i, --interactive  Start interactive mode\n";
     cout << "  --test             Run search test demonstration\n";
     cout << "  --test-add         Run record addition test (Phase 1)\n";
+    cout << "  --upgrade          Upgrade a BSS file to the current block format\n";
+    cout << "  --create           Create a BSS file from a Project 2.0 .dat file\n";
+    cout << "  --create-csv       Create a BSS file and its index from a CSV file\n";
+    cout << "  --bench-lookup     Benchmark lookups (default: Data/zipCodes.bss, 100000 keys)\n";
+    cout << "  --bench-layout     Benchmark block size and fill factor choices\n";
+    cout << "  --bench-create     Benchmark parallel create (default: 10 replicas, 8 threads)\n";
+    cout << "  --bench-convert    Benchmark CSV conversion (default: Data/us_postal_codes.csv, 30 replicas, 8 threads)\n";
+    cout << "  --bench-index      Benchmark index search (default: up to 1000000 entries)\n";
+    cout << "  --bench-apply      Benchmark change sets (default: Data/zipCodes.bss, up to 10000 changes)\n";
+    cout << "  --bench-parse      Benchmark record parsing (default: Data/us_postal_codes.csv, Data/us_postal_rand.csv)\n";
     cout << "  <bss_file>         Path to the blocked sequence set file\n";
     cout << "  -Z<zipcode>        Zip code to search for (e.g., -Z10001)\n\n";
     cout << "Examples:\n";
@@ -772,6 +894,118 @@ int main(int argc, char* argv[]) {
     const string defaultBssFile = "Data/zipCodes.bss";
     const string defaultBssIndexFile = "Data/zipCodes.bss.idx";
 
+    // Check for upgrade mode flag
+    if ((argc == 3 || argc == 4) && string(argv[1]) == "--upgrade") {
+        string oldBss = argv[2];
+        string newBss = (argc == 4) ? argv[3] : oldBss;
+        upgradeBSSFile(oldBss, newBss);
+        return 0;
+    }
+
+    // Check for create mode flag
+    if (argc >= 4 && string(argv[1]) == "--create") {
+        BSSCreateOptions options;
+        if (!parseCreateOptions(argc, argv, options)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        createBSSFile(argv[2], argv[3], options);
+        return 0;
+    }
+
+    // Check for create-from-CSV mode flag
+    if (argc >= 4 && string(argv[1]) == "--create-csv") {
+        BSSCreateOptions options;
+        if (!parseCreateOptions(argc, argv, options)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        createBSSFileFromCsv(argv[2], argv[3], options);
+        return 0;
+    }
+
+    // Check for lookup benchmark flag
+    if (argc >= 2 && argc <= 4 && string(argv[1]) == "--bench-lookup") {
+        string bss = (argc >= 3) ? argv[2] : defaultBssFile;
+        size_t count = 100000;
+        if (argc == 4 && !parseCount(argv[3], "count", count)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        benchmarkLookups(bss, count);
+        return 0;
+    }
+
+    // Check for block layout benchmark flag
+    if (argc >= 2 && argc <= 3 && string(argv[1]) == "--bench-layout") {
+        string dat = (argc == 3) ? argv[2] : defaultBinaryFile;
+        benchmarkBlockLayout(dat, 20000, 2000);
+        return 0;
+    }
+
+    // Check for create benchmark flag
+    if (argc >= 2 && argc <= 5 && string(argv[1]) == "--bench-create") {
+        string dat = (argc >= 3) ? argv[2] : defaultBinaryFile;
+        size_t replicas = 10;
+        size_t maxThreads = 8;
+        if ((argc >= 4 && !parseCount(argv[3], "replica count", replicas, numeric_limits<unsigned>::max())) ||
+            (argc == 5 && !parseCount(argv[4], "thread count", maxThreads, numeric_limits<unsigned>::max()))) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        benchmarkCreate(dat, (unsigned)replicas, (unsigned)maxThreads);
+        return 0;
+    }
+
+    // Check for conversion benchmark flag
+    if (argc >= 2 && argc <= 5 && string(argv[1]) == "--bench-convert") {
+        string csv = (argc >= 3) ? argv[2] : "Data/us_postal_codes.csv";
+        size_t replicas = 30;
+        size_t maxThreads = 8;
+        if ((argc >= 4 && !parseCount(argv[3], "replica count", replicas, numeric_limits<unsigned>::max())) ||
+            (argc == 5 && !parseCount(argv[4], "thread count", maxThreads, numeric_limits<unsigned>::max()))) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        benchmarkConvert(csv, (unsigned)replicas, (unsigned)maxThreads);
+        return 0;
+    }
+
+    // Check for index benchmark flag
+    if (argc >= 2 && argc <= 4 && string(argv[1]) == "--bench-index") {
+        size_t maxEntries = 1000000;
+        size_t count = 1000000;
+        if ((argc >= 3 && !parseCount(argv[2], "entry count", maxEntries)) ||
+            (argc == 4 && !parseCount(argv[3], "count", count))) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        benchmarkIndex(maxEntries, count);
+        return 0;
+    }
+
+    // Check for change set benchmark flag
+    if (argc >= 2 && argc <= 4 && string(argv[1]) == "--bench-apply") {
+        string bss = (argc >= 3) ? argv[2] : defaultBssFile;
+        size_t maxChanges = 10000;
+        if (argc == 4 && !parseCount(argv[3], "change count", maxChanges)) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        benchmarkApplyChanges(bss, maxChanges);
+        return 0;
+    }
+
+    // Check for parsing benchmark flag
+    if (argc >= 2 && string(argv[1]) == "--bench-parse") {
+        vector<string> csvFiles(argv + 2, argv + argc);
+        if (csvFiles.empty()) {
+            csvFiles = {"Data/us_postal_codes.csv", "Data/us_postal_rand.csv"};
+        }
+        benchmarkParsing(csvFiles, 20);
+        return 0;
+    }
+
     // Check for addition test mode flag
     if (argc == 2 && string(argv[1]) == "--test-add") {
         cout << "=== RECORD ADDITION TEST MODE ===\n\n";
@@ -874,7 +1108,7 @@ int main(int argc, char* argv[]) {
         cout << string(80, '=') << "\n";
 
         BSSFile file;
-        if (file.open(defaultBssFile)) {
+        if (file.open(defaultBssFile, BSSFile::OpenMode::MappedReadOnly)) {
             file.dumpLogical(cout);
             file.close();
         }